@@ -15,6 +15,11 @@ typedef struct Zobrist {
 
 static Zobrist zobristHashes;
 
+// Cuckoo tables of every reversible piece move, keyed by the change the move makes to the position key (Marcel van Kervinck)
+constexpr int CUCKOO_SIZE = 8192;
+static Key cuckooKeys[CUCKOO_SIZE];
+static Move cuckooMoves[CUCKOO_SIZE];
+
 Bitboard fullLine[SQUARES][SQUARES];
 Bitboard inBetweenLine[SQUARES][SQUARES];
 
@@ -32,24 +37,29 @@ constexpr CastlingRights CASTLING_RIGHTS_MASK[SQUARES] = {
 
 static inline void addPiece(ChessBoard *restrict board, Colour c, PieceType pt, Square sq) {
     Bitboard sqBB = squareToBitboard(sq);
-    board->pieceTypes[sq] = pt;
-    board->pieces[c][pt] |= sqBB;
-    board->pieces[c][ALL_PIECES] |= sqBB;
+    board->mailbox[sq] = makePiece(c, pt);
+    board->pieces[pt] |= sqBB;
+    board->pieces[ALL_PIECES] |= sqBB;
+    board->colours[c] |= sqBB;
+    if (pt == KING) board->kingSquare[c] = sq;
 }
 
 static inline void movePiece(ChessBoard *restrict board, Colour c, PieceType pt, Square fromSquare, Square toSquare) {
     Bitboard fromToBB = squareToBitboard(fromSquare) | squareToBitboard(toSquare);
-    board->pieceTypes[toSquare] = pt;
-    board->pieceTypes[fromSquare] = NO_PIECE;
-    board->pieces[c][pt] ^= fromToBB;
-    board->pieces[c][ALL_PIECES] ^= fromToBB;
+    board->mailbox[fromSquare] = NO_PIECE;
+    board->mailbox[toSquare] = makePiece(c, pt);
+    board->pieces[pt] ^= fromToBB;
+    board->pieces[ALL_PIECES] ^= fromToBB;
+    board->colours[c] ^= fromToBB;
+    if (pt == KING) board->kingSquare[c] = toSquare;
 }
 
 static inline void removePiece(ChessBoard *restrict board, Colour c, PieceType pt, Square sq) {
     Bitboard sqBB = squareToBitboard(sq);
-    board->pieceTypes[sq] = NO_PIECE;
-    board->pieces[c][pt] ^= sqBB;
-    board->pieces[c][ALL_PIECES] ^= sqBB;
+    board->mailbox[sq] = NO_PIECE;
+    board->pieces[pt] ^= sqBB;
+    board->pieces[ALL_PIECES] ^= sqBB;
+    board->colours[c] ^= sqBB;
 }
 
 static void initializeZobrist() {
@@ -72,41 +82,95 @@ static void initializeZobrist() {
     zobristHashes.sideToMove = random64BitNumber(&seed);
 }
 
+// Updates every key that depends on where the piece is, the material key is updated separately
+static inline void togglePieceKeys(ChessBoardHistory *restrict state, Colour c, PieceType pt, Square sq) {
+    Key key = zobristHashes.pieceOnSquare[pt + COLOUR_OFFSET * c][sq];
+    state->positionKey ^= key;
+    if (pt == PAWN) state->pawnKey ^= key;
+    else state->nonPawnKey[c] ^= key;
+}
+
+// The key of the nth piece of a type is the key of that piece on the nth square, so the key only depends on the counts
+static inline void toggleMaterialKey(ChessBoardHistory *restrict state, Colour c, PieceType pt, int count) {
+    state->materialKey ^= zobristHashes.pieceOnSquare[pt + COLOUR_OFFSET * c][count];
+}
+
+static inline int cuckooHash1(Key key) {
+    return key & (CUCKOO_SIZE - 1);
+}
+
+static inline int cuckooHash2(Key key) {
+    return (key >> 16) & (CUCKOO_SIZE - 1);
+}
+
+// Only one of the two directions is stored, the key difference is the same for both
+static void initializeCuckoo() {
+    for (Colour c = WHITE; c <= BLACK; c++) {
+        for (PieceType pt = KNIGHT; pt <= KING; pt++) {
+            for (Square sq1 = 0; sq1 < SQUARES; sq1++) {
+                for (Square sq2 = sq1 + 1; sq2 < SQUARES; sq2++) {
+                    if (!(getAttacks(pt, 0, sq1) & squareToBitboard(sq2))) continue;
+                    Move move = sq2 << 6 | sq1;
+                    Key key = zobristHashes.pieceOnSquare[pt + COLOUR_OFFSET * c][sq1] ^ zobristHashes.pieceOnSquare[pt + COLOUR_OFFSET * c][sq2] ^ zobristHashes.sideToMove;
+                    int i = cuckooHash1(key);
+                    while (true) {
+                        Key tempKey = cuckooKeys[i];
+                        cuckooKeys[i] = key;
+                        key = tempKey;
+                        Move tempMove = cuckooMoves[i];
+                        cuckooMoves[i] = move;
+                        move = tempMove;
+                        if (!move) break;
+                        i = i == cuckooHash1(key) ? cuckooHash2(key) : cuckooHash1(key);
+                    }
+                }
+            }
+        }
+    }
+}
+
 static bool fiftyMoveRule(const ChessBoard *restrict board) {
     return board->history->halfmoveClock > 99 && (!getCheckers(board) || anyLegalMoves(board));
 }
 
-static Bitboard getPinnedPieces(const ChessBoard *restrict board) {
-    Colour stm = board->sideToMove;
-    Colour enemy = stm ^ 1;
-    Square kingSq = getKingSquare(board, stm);
-    Bitboard enemyQueens = getPieces(board, enemy, QUEEN);
-    Bitboard stmPieces = getPieces(board, stm, ALL_PIECES);
-    Bitboard occupiedSquares = stmPieces | getPieces(board, enemy, ALL_PIECES);
+// Candidates that are the only piece between a slider of the attacker and the king square
+static Bitboard getBlockers(const ChessBoard *restrict board, Square kingSq, Colour attacker, Bitboard candidates) {
+    Bitboard queens = getPieces(board, attacker, QUEEN);
+    Bitboard occupiedSquares = getOccupiedSquares(board);
 
     Bitboard attacks = getSliderAttacks(ROOK_SLIDER, occupiedSquares, kingSq);
-    Bitboard potentiallyPinned = attacks & stmPieces;
-    Bitboard pinners = (getSliderAttacks(ROOK_SLIDER, occupiedSquares ^ potentiallyPinned, kingSq) ^ attacks) & (getPieces(board, enemy, ROOK) | enemyQueens);
+    Bitboard potentialBlockers = attacks & candidates;
+    Bitboard sliders = (getSliderAttacks(ROOK_SLIDER, occupiedSquares ^ potentialBlockers, kingSq) ^ attacks) & (getPieces(board, attacker, ROOK) | queens);
 
-    Bitboard pinned = 0;
-    while (pinners) pinned |= inBetweenLine[bitboardToSquareWithReset(&pinners)][kingSq] & potentiallyPinned;
+    Bitboard blockers = 0;
+    while (sliders) blockers |= inBetweenLine[bitboardToSquareWithReset(&sliders)][kingSq] & potentialBlockers;
 
     attacks = getSliderAttacks(BISHOP_SLIDER, occupiedSquares, kingSq);
-    potentiallyPinned = attacks & stmPieces;
-    pinners = (getSliderAttacks(BISHOP_SLIDER, occupiedSquares ^ potentiallyPinned, kingSq) ^ attacks) & (getPieces(board, enemy, BISHOP) | enemyQueens);
-    while (pinners) pinned |= inBetweenLine[bitboardToSquareWithReset(&pinners)][kingSq] & potentiallyPinned;
+    potentialBlockers = attacks & candidates;
+    sliders = (getSliderAttacks(BISHOP_SLIDER, occupiedSquares ^ potentialBlockers, kingSq) ^ attacks) & (getPieces(board, attacker, BISHOP) | queens);
+    while (sliders) blockers |= inBetweenLine[bitboardToSquareWithReset(&sliders)][kingSq] & potentialBlockers;
 
-    return pinned;
+    return blockers;
 }
 
-static Bitboard attackersTo(const ChessBoard *restrict board, Square sq, Colour attackedSide, Bitboard occupied) {
-    Colour enemy = attackedSide ^ 1;
-    Bitboard queens = getPieces(board, enemy, QUEEN);
-    return (getPawnAttacks(attackedSide, sq) & getPieces(board, enemy, PAWN))
-         | (getNonSliderAttacks(KNIGHT_NON_SLIDER, sq) & getPieces(board, enemy, KNIGHT))
-         | (getSliderAttacks(BISHOP_SLIDER, occupied, sq) & (getPieces(board, enemy, BISHOP) | queens))
-         | (getSliderAttacks(ROOK_SLIDER, occupied, sq) & (getPieces(board, enemy, ROOK)   | queens))
-         | (getNonSliderAttacks(KING_NON_SLIDER, sq) &  getPieces(board, enemy, KING));
+Bitboard computePinnedPieces(const ChessBoard *restrict board) {
+    Colour stm = board->sideToMove;
+    return getBlockers(board, getKingSquare(board, stm), stm ^ 1, getColourPieces(board, stm));
+}
+
+// Computed together on the first givesCheck of a position, most positions never need them
+static void computeCheckInfo(const ChessBoard *restrict board) {
+    ChessBoardHistory *state = board->history;
+    Colour stm = board->sideToMove;
+    Square enemyKingSq = getKingSquare(board, stm ^ 1);
+    Bitboard occupied = getOccupiedSquares(board);
+    state->checkSquares[PAWN]   = getPawnAttacks(stm ^ 1, enemyKingSq);
+    state->checkSquares[KNIGHT] = getNonSliderAttacks(KNIGHT_NON_SLIDER, enemyKingSq);
+    state->checkSquares[BISHOP] = getSliderAttacks(BISHOP_SLIDER, occupied, enemyKingSq);
+    state->checkSquares[ROOK]   = getSliderAttacks(ROOK_SLIDER, occupied, enemyKingSq);
+    state->checkSquares[QUEEN]  = state->checkSquares[BISHOP] | state->checkSquares[ROOK];
+    state->checkSquares[KING]   = 0;
+    state->discoveredCheckers   = getBlockers(board, enemyKingSq, stm, getColourPieces(board, stm));
 }
 
 void initializeChessBoard() {
@@ -138,6 +202,7 @@ void initializeChessBoard() {
             inBetweenLine[sq2][sq1] = inBetween;
         }
     }
+    initializeCuckoo();
 }
 
 void parseFEN(ChessBoard *restrict board, ChessBoardHistory *restrict history, Accumulator *restrict accumulator, const char *restrict fen) {
@@ -167,7 +232,7 @@ void parseFEN(ChessBoard *restrict board, ChessBoardHistory *restrict history, A
     *history = (ChessBoardHistory) {0};
     *board   = (ChessBoard       ) {0};
 
-    accumulatorReset(accumulator); // TODO: Could this be done somewhere else?
+    if (accumulator) accumulatorReset(accumulator); // TODO: Could this be done somewhere else?
     board->history = history;
     /* 1) Piece Placement */
     Square sq = A8;
@@ -175,8 +240,8 @@ void parseFEN(ChessBoard *restrict board, ChessBoardHistory *restrict history, A
         unsigned char ch = *fen++;
         if (ch > 'A') {
             addPiece(board, CHAR_TO_COLOUR[ch], CHAR_TO_PIECE_TYPE[ch], sq);
-            accumulatorAdd(accumulator, CHAR_TO_COLOUR[ch], CHAR_TO_PIECE_TYPE[ch], sq);
-            history->positionKey ^= zobristHashes.pieceOnSquare[CHAR_TO_PIECE_TYPE[ch] + COLOUR_OFFSET * CHAR_TO_COLOUR[ch]][sq++];
+            if (accumulator) accumulatorAdd(accumulator, CHAR_TO_COLOUR[ch], CHAR_TO_PIECE_TYPE[ch], sq);
+            togglePieceKeys(history, CHAR_TO_COLOUR[ch], CHAR_TO_PIECE_TYPE[ch], sq++);
         } else if (ch > '/') {
             sq += ch - '0';
         }
@@ -212,8 +277,23 @@ void parseFEN(ChessBoard *restrict board, ChessBoardHistory *restrict history, A
     board->ply = (board->ply << 1) - (board->sideToMove ^ 1);
 
     /* 7) Miscellaneous Data */
+    for (Colour c = WHITE; c <= BLACK; c++)
+        for (PieceType pt = PAWN; pt <= KING; pt++)
+            for (int count = 0; count < populationCount(getPieces(board, c, pt)); count++) toggleMaterialKey(history, c, pt, count);
     history->checkers = attackersTo(board, getKingSquare(board, board->sideToMove), board->sideToMove, getOccupiedSquares(board));
-    history->pinnedPieces = getPinnedPieces(board);
+    history->pinnedPieces = NOT_COMPUTED;
+    history->discoveredCheckers = NOT_COMPUTED;
+}
+
+void refreshAccumulator(Accumulator *restrict accumulator, const ChessBoard *restrict board) {
+    accumulatorReset(accumulator);
+    for (Colour c = WHITE; c <= BLACK; c++) {
+        Bitboard pieces = getColourPieces(board, c);
+        while (pieces) {
+            Square sq = bitboardToSquareWithReset(&pieces);
+            accumulatorAdd(accumulator, c, getPieceType(board, sq), sq);
+        }
+    }
 }
 
 void getFEN(const ChessBoard *restrict board, char *restrict destination) {
@@ -226,11 +306,11 @@ void getFEN(const ChessBoard *restrict board, char *restrict destination) {
     /* 1) Piece Placement */
     int empty = 0;
     for (Square sq = A8; sq < SQUARES; sq++) {
-        if (board->pieceTypes[sq]) {
+        if (getPiece(board, sq)) {
             if (empty) *destination++ = '0' + empty;
             empty = 0;
-            char ch = PIECE_TYPE_TO_CHAR[board->pieceTypes[sq]];
-            *destination++ = ch + 32 * (bool) (board->pieces[BLACK][board->pieceTypes[sq]] & squareToBitboard(sq));
+            char ch = PIECE_TYPE_TO_CHAR[getPieceType(board, sq)];
+            *destination++ = ch + 32 * (getPiece(board, sq) >> PIECE_COLOUR_SHIFT);
         } else empty++;
 
         if (squareToBitboard(sq) & FILE_H_BB) {
@@ -290,61 +370,78 @@ void getFEN(const ChessBoard *restrict board, char *restrict destination) {
     *destination = '\0';
 }
 
-void makeNullMove(ChessBoard *restrict board, ChessBoardHistory *restrict newState) {
-    newState->previous       = board->history;
+void makeNullMove(ChessBoard *restrict board) {
+    ChessBoardHistory *newState = board->history + 1;
     newState->positionKey    = getEnPassant(board) != NO_SQUARE ? getPositionKey(board) ^ zobristHashes.enPassant[squareToFile(getEnPassant(board))] : getPositionKey(board);
     newState->positionKey   ^= zobristHashes.sideToMove;
+    newState->pawnKey        = board->history->pawnKey;
+    newState->nonPawnKey[WHITE] = board->history->nonPawnKey[WHITE];
+    newState->nonPawnKey[BLACK] = board->history->nonPawnKey[BLACK];
+    newState->materialKey    = board->history->materialKey;
     newState->castlingRights = board->history->castlingRights;
-    newState->halfmoveClock  = 0;
+    newState->halfmoveClock  = board->history->halfmoveClock + 1;
+    newState->pliesFromNull  = 0;
     newState->enPassant      = NO_SQUARE;
     newState->checkers       = 0;
+    newState->pinnedPieces   = NOT_COMPUTED;
+    newState->discoveredCheckers = NOT_COMPUTED;
 
     board->history = newState;
     board->sideToMove ^= 1;
-    newState->pinnedPieces = getPinnedPieces(board);
 }
 
-void makeMove(ChessBoard *restrict board, ChessBoardHistory *restrict newState, Accumulator *restrict accumulator, Move move) {
+// The accumulator may be nullptr when no evaluation is needed, such as perft or tablebase probing
+void makeMove(ChessBoard *restrict board, Accumulator *restrict accumulator, Move move) {
     Square fromSquare = getFromSquare(move);
     Square   toSquare = getToSquare  (move);
     MoveType moveType = getMoveType  (move);
     Colour stm = board->sideToMove, enemy = board->sideToMove ^ 1;
     Square captureSquare = moveType & EN_PASSANT ? moveSquareInDirection(toSquare, stm ? NORTH : SOUTH) : toSquare;
-    PieceType colOffset = COLOUR_OFFSET * stm, fromPiece = board->pieceTypes[fromSquare];
+    PieceType fromPiece = getPieceType(board, fromSquare);
 
-    newState->previous       = board->history;
+    ChessBoardHistory *newState = board->history + 1;
     newState->positionKey    = getEnPassant(board) != NO_SQUARE ? getPositionKey(board) ^ zobristHashes.enPassant[squareToFile(getEnPassant(board))] : getPositionKey(board);
-    newState->capturedPiece  = board->pieceTypes[captureSquare];
+    newState->pawnKey        = board->history->pawnKey;
+    newState->nonPawnKey[WHITE] = board->history->nonPawnKey[WHITE];
+    newState->nonPawnKey[BLACK] = board->history->nonPawnKey[BLACK];
+    newState->materialKey    = board->history->materialKey;
+    newState->capturedPiece  = getPieceType(board, captureSquare);
     newState->castlingRights = board->history->castlingRights;
     newState->halfmoveClock  = fromPiece == PAWN ? 0 : board->history->halfmoveClock + 1;
+    newState->pliesFromNull  = board->history->pliesFromNull + 1;
+    newState->pinnedPieces   = NOT_COMPUTED;
+    newState->discoveredCheckers = NOT_COMPUTED;
 
     if (newState->capturedPiece) {
         removePiece(board, enemy, newState->capturedPiece, captureSquare);
-        accumulatorSub(accumulator, enemy, newState->capturedPiece, captureSquare);
-        newState->positionKey ^= zobristHashes.pieceOnSquare[newState->capturedPiece + COLOUR_OFFSET * enemy][captureSquare];
+        if (accumulator) accumulatorSub(accumulator, enemy, newState->capturedPiece, captureSquare);
+        togglePieceKeys(newState, enemy, newState->capturedPiece, captureSquare);
+        toggleMaterialKey(newState, enemy, newState->capturedPiece, populationCount(getPieces(board, enemy, newState->capturedPiece)));
         newState->halfmoveClock = 0;
     } else if (moveType == CASTLE) {
         bool isKingSideCastle = toSquare > fromSquare;
         Square rookFromSquare = isKingSideCastle ? moveSquareInDirection(toSquare  , EAST) : moveSquareInDirection(toSquare  , WEST + WEST);
         Square rookToSquare   = isKingSideCastle ? moveSquareInDirection(fromSquare, EAST) : moveSquareInDirection(fromSquare, WEST       );
         movePiece(board, stm, ROOK, rookFromSquare, rookToSquare);
-        accumulatorAddSub(accumulator, stm, ROOK, rookFromSquare, rookToSquare);
-        newState->positionKey ^= zobristHashes.pieceOnSquare[ROOK + colOffset][rookFromSquare] 
-                              ^  zobristHashes.pieceOnSquare[ROOK + colOffset][rookToSquare  ];
+        if (accumulator) accumulatorAddSub(accumulator, stm, ROOK, rookFromSquare, rookToSquare);
+        togglePieceKeys(newState, stm, ROOK, rookFromSquare);
+        togglePieceKeys(newState, stm, ROOK, rookToSquare  );
     }
 
     if (moveType & PROMOTION) {
         PieceType pt = KNIGHT + (moveType & PROMOTION_PIECE_MASK);
-        newState->positionKey ^= zobristHashes.pieceOnSquare[PAWN + colOffset][fromSquare] 
-                              ^  zobristHashes.pieceOnSquare[pt   + colOffset][toSquare  ];
+        togglePieceKeys(newState, stm, PAWN, fromSquare);
+        togglePieceKeys(newState, stm, pt  , toSquare  );
         removePiece(board, stm, PAWN, fromSquare);
+        toggleMaterialKey(newState, stm, PAWN, populationCount(getPieces(board, stm, PAWN)));
+        toggleMaterialKey(newState, stm, pt  , populationCount(getPieces(board, stm, pt  )));
         addPiece(board, stm, pt, toSquare);
-        accumulatorAddSubPromotion(accumulator, stm, pt, fromSquare, toSquare);
+        if (accumulator) accumulatorAddSubPromotion(accumulator, stm, pt, fromSquare, toSquare);
     } else {
         movePiece(board, stm, fromPiece, fromSquare, toSquare);
-        accumulatorAddSub(accumulator, stm, fromPiece, fromSquare, toSquare);
-        newState->positionKey ^= zobristHashes.pieceOnSquare[fromPiece + colOffset][fromSquare] 
-                              ^  zobristHashes.pieceOnSquare[fromPiece + colOffset][toSquare  ];
+        if (accumulator) accumulatorAddSub(accumulator, stm, fromPiece, fromSquare, toSquare);
+        togglePieceKeys(newState, stm, fromPiece, fromSquare);
+        togglePieceKeys(newState, stm, fromPiece, toSquare  );
     }
 
     if (newState->castlingRights) {
@@ -364,7 +461,6 @@ void makeMove(ChessBoard *restrict board, ChessBoardHistory *restrict newState,
     board->ply++;
     newState->positionKey ^= zobristHashes.sideToMove;
     newState->checkers = attackersTo(board, getKingSquare(board, enemy), enemy, getOccupiedSquares(board));
-    newState->pinnedPieces = getPinnedPieces(board);
 }
 
 void undoMove(ChessBoard *restrict board, Move move) {
@@ -374,14 +470,14 @@ void undoMove(ChessBoard *restrict board, Move move) {
     Colour stm = board->sideToMove ^= 1;
     PieceType capturedPiece = board->history->capturedPiece;
 
-    board->history = board->history->previous;
+    board->history--;
     board->ply--;
     
     if (moveType & PROMOTION) {
-        removePiece(board, stm, board->pieceTypes[toSquare], toSquare);
+        removePiece(board, stm, getPieceType(board, toSquare), toSquare);
         addPiece(board, stm, PAWN, fromSquare);
     } else {
-        movePiece(board, stm, board->pieceTypes[toSquare], toSquare, fromSquare);
+        movePiece(board, stm, getPieceType(board, toSquare), toSquare, fromSquare);
     }
 
     if (capturedPiece) {
@@ -398,6 +494,37 @@ void undoMove(ChessBoard *restrict board, Move move) {
 // TODO: Threefold repetition, greater or equal to 8
 // TODO: Stalemate
 // TODO: Null pointer checks needed if the previous positions are not there such as setting FEN to not start
+// A previous position that differs by one reversible move which is not blocked can be reached again.
+// Only positions inside the search (less than ply plies ago) are considered, earlier ones could be repeated by the opponent's move.
+bool hasUpcomingRepetition(const ChessBoard *restrict board, int ply) {
+    const ChessBoardHistory *current = board->history;
+    int end = min(current->halfmoveClock, current->pliesFromNull);
+    Bitboard occupied = getOccupiedSquares(board);
+    for (int i = 3; i <= end && i < ply; i += 2) {
+        Key moveKey = current->positionKey ^ current[-i].positionKey;
+        int j = cuckooHash1(moveKey);
+        if (cuckooKeys[j] != moveKey) j = cuckooHash2(moveKey);
+        if (cuckooKeys[j] != moveKey) continue;
+
+        Square fromSquare = getFromSquare(cuckooMoves[j]);
+        Square toSquare   = getToSquare  (cuckooMoves[j]);
+        if (!((inBetweenLine[fromSquare][toSquare] ^ squareToBitboard(fromSquare) ^ squareToBitboard(toSquare)) & occupied)) return true;
+    }
+    return false;
+}
+
+// Castling rights and en passant are ignored, it is only precise enough to find the TT bucket ahead of time
+Key getKeyAfter(const ChessBoard *restrict board, Move move) {
+    Square fromSquare = getFromSquare(move);
+    Square   toSquare = getToSquare  (move);
+    uint8_t piece    = getPiece(board, fromSquare);
+    uint8_t captured = getPiece(board, toSquare);
+    int pieceIndex = (piece & PIECE_TYPE_MASK) + COLOUR_OFFSET * (piece >> PIECE_COLOUR_SHIFT);
+    Key key = getPositionKey(board) ^ zobristHashes.sideToMove ^ zobristHashes.pieceOnSquare[pieceIndex][fromSquare] ^ zobristHashes.pieceOnSquare[pieceIndex][toSquare];
+    if (captured) key ^= zobristHashes.pieceOnSquare[(captured & PIECE_TYPE_MASK) + COLOUR_OFFSET * (captured >> PIECE_COLOUR_SHIFT)][toSquare];
+    return key;
+}
+
 bool isDraw(const ChessBoard *restrict board) {
     return fiftyMoveRule(board) || insufficientMaterial(board) || isRepetition(board);
 }
@@ -433,18 +560,99 @@ bool isLegalMove(const ChessBoard *restrict board, Move move) {
         return !attackersTo(board, toSquare, stm, getOccupiedSquares(board) ^ fromSquareBB);
     }
     
-    return !(board->history->pinnedPieces & fromSquareBB) || fullLine[fromSquare][toSquare] & squareToBitboard(kingSquare);
+    return !(getPinnedPieces(board) & fromSquareBB) || fullLine[fromSquare][toSquare] & squareToBitboard(kingSquare);
 }
 
-// TODO: Need to find minimum validation to assert correctness
+// Checks a move from another position, such as the TT move, without generating moves: the piece must be able to make it
+// and isLegalMove decides the rest. Castling is rare enough to be checked against the generated castle moves
 bool isPseudoMove(const ChessBoard *restrict board, Move move) {
-    MoveObject moveList[256];
-    MoveObject *startList = moveList;
-    MoveObject *endList = createMoveList(board, moveList, CAPTURES);
-    endList = createMoveList(board, endList, NON_CAPTURES);
-    while (startList < endList) {
-        if (startList->move == move) return true;
-        startList++;
+    Square fromSquare = getFromSquare(move);
+    Square   toSquare = getToSquare  (move);
+    MoveType moveType = getMoveType  (move);
+    Colour stm = board->sideToMove;
+    uint8_t piece = getPiece(board, fromSquare);
+    Bitboard toSquareBB = squareToBitboard(toSquare);
+    Bitboard occupied = getOccupiedSquares(board);
+    Bitboard checkers = getCheckers(board);
+    if (!piece || piece >> PIECE_COLOUR_SHIFT != stm || getColourPieces(board, stm) & toSquareBB) return false;
+
+    /* 1) Castling */
+    if (moveType == CASTLE) {
+        if (checkers) return false;
+        MoveObject moveList[CASTLING_SIDES];
+        MoveObject *endList = generateCastleMoves(board, moveList);
+        for (MoveObject *mo = moveList; mo < endList; mo++)
+            if (mo->move == move) return true;
+        return false;
+    }
+
+    /* 2) Piece Movement */
+    PieceType pt = piece & PIECE_TYPE_MASK;
+    if (pt == PAWN) {
+        if (moveType > QUEEN_PROMOTION || (moveType > DOUBLE_PAWN_PUSH && moveType < KNIGHT_PROMOTION && moveType != EN_PASSANT)) return false;
+        Direction pawnPush = stm ? SOUTH : NORTH;
+        bool reachesLastRank = toSquareBB & (stm ? RANK_1_BB : RANK_8_BB);
+        if (reachesLastRank != (bool) (moveType & PROMOTION)) return false;
+        if (moveType == EN_PASSANT) {
+            if (toSquare != getEnPassant(board) || !(getPawnAttacks(stm, fromSquare) & toSquareBB)) return false;
+        } else if (getPawnAttacks(stm, fromSquare) & toSquareBB) {
+            if (moveType == DOUBLE_PAWN_PUSH || !(occupied & toSquareBB)) return false;
+        } else {
+            Square pushSquare = moveSquareInDirection(fromSquare, pawnPush);
+            if (occupied & toSquareBB) return false;
+            if (moveType == DOUBLE_PAWN_PUSH) {
+                if (occupied & squareToBitboard(pushSquare) || !(toSquareBB & (stm ? RANK_5_BB : RANK_4_BB))
+                    || toSquare != moveSquareInDirection(pushSquare, pawnPush)) return false;
+            } else if (toSquare != pushSquare) return false;
+        }
+    } else if (moveType != QUIET || !(getAttacks(pt, occupied, fromSquare) & toSquareBB)) return false;
+
+    /* 3) Check Evasion */
+    // Other pieces must capture or block a single checker, en passant is left to isLegalMove like in move generation
+    if (checkers && pt != KING && moveType != EN_PASSANT) {
+        if (populationCount(checkers) > 1) return false;
+        if (!((checkers | inBetweenLine[getKingSquare(board, stm)][bitboardToSquare(checkers)]) & toSquareBB)) return false;
+    }
+    return isLegalMove(board, move);
+}
+
+bool givesCheck(const ChessBoard *restrict board, Move move) {
+    if (board->history->discoveredCheckers == NOT_COMPUTED) computeCheckInfo(board);
+    const ChessBoardHistory *state = board->history;
+    Square fromSquare = getFromSquare(move);
+    Square   toSquare = getToSquare  (move);
+    MoveType moveType = getMoveType  (move);
+    Colour stm = board->sideToMove;
+    Square enemyKingSq = getKingSquare(board, stm ^ 1);
+    Bitboard fromSquareBB = squareToBitboard(fromSquare);
+    Bitboard toSquareBB = squareToBitboard(toSquare);
+
+    /* 1) Direct Check */
+    if (!(moveType & PROMOTION) && state->checkSquares[getPieceType(board, fromSquare)] & toSquareBB) return true;
+
+    /* 2) Discovered Check */
+    if ((state->discoveredCheckers & fromSquareBB) && !(fullLine[fromSquare][enemyKingSq] & toSquareBB)) return true;
+
+    /* 3) Special Moves */
+    Bitboard occupied = getOccupiedSquares(board) ^ fromSquareBB;
+    if (moveType & PROMOTION) {
+        return getAttacks(KNIGHT + (moveType & PROMOTION_PIECE_MASK), occupied, toSquare) & squareToBitboard(enemyKingSq);
+    } else if (moveType == EN_PASSANT) {
+        // The captured pawn can uncover a slider as well
+        occupied ^= toSquareBB ^ squareToBitboard(moveSquareInDirection(toSquare, stm ? NORTH : SOUTH));
+        Bitboard queens = getPieces(board, stm, QUEEN);
+        return (getSliderAttacks(BISHOP_SLIDER, occupied, enemyKingSq) & (getPieces(board, stm, BISHOP) | queens))
+             | (getSliderAttacks(ROOK_SLIDER  , occupied, enemyKingSq) & (getPieces(board, stm, ROOK  ) | queens));
+    } else if (moveType == CASTLE) {
+        // Either the rook checks or moving it uncovers a slider
+        bool isKingSideCastle = toSquare > fromSquare;
+        Square rookFromSquare = isKingSideCastle ? moveSquareInDirection(toSquare  , EAST) : moveSquareInDirection(toSquare  , WEST + WEST);
+        Square rookToSquare   = isKingSideCastle ? moveSquareInDirection(fromSquare, EAST) : moveSquareInDirection(fromSquare, WEST       );
+        Bitboard rookFromToBB = squareToBitboard(rookFromSquare) | squareToBitboard(rookToSquare);
+        occupied ^= toSquareBB ^ rookFromToBB;
+        Bitboard queens = getPieces(board, stm, QUEEN);
+        return (getSliderAttacks(BISHOP_SLIDER, occupied, enemyKingSq) & (getPieces(board, stm, BISHOP) | queens))
+             | (getSliderAttacks(ROOK_SLIDER  , occupied, enemyKingSq) & ((getPieces(board, stm, ROOK) ^ rookFromToBB) | queens));
     }
     return false;
 }
@@ -2,29 +2,49 @@
 #define CHESS_BOARD_H
 
 #include <stdint.h>
+#include <string.h>
 #include "utility.h"
+#include "attacks.h"
 #include "nnue.h"
 
-// Uses a linked list to keep track of the history of the game. 
+// Enough for every position that can still repeat (bounded by the halfmove clock) plus the deepest search
+constexpr int MAX_HISTORY = 1024;
+
+// Uses a contiguous stack to keep track of the history of the game, the previous position is at history - 1.
 // Maintains information that is lost when a move is made but also
 // information that is expensive to compute so instead of recomputing it is saved. 
 typedef struct ChessBoardHistory {
-    struct ChessBoardHistory *previous; // TODO: Consider making it an array in the struct, or pointer that is sequential
     Key positionKey;
+    Key pawnKey;
+    Key nonPawnKey[COLOURS]; // Includes the king
+    Key materialKey; // Depends only on the number of each piece
     Bitboard checkers;
-    Bitboard pinnedPieces;
+    Bitboard pinnedPieces; // NOT_COMPUTED until the first legality check needs them, see getPinnedPieces
+    Bitboard discoveredCheckers; // Pieces of the side to move that uncover a check by moving off the line to the enemy king
+    Bitboard checkSquares[PIECE_TYPES]; // Squares each piece type of the side to move would give check from
     PieceType capturedPiece;
     Square enPassant;
     CastlingRights castlingRights;
     uint8_t halfmoveClock; // TODO: Maybe the type
+    uint16_t pliesFromNull; // Also reset by parseFEN, so it bounds how far back the stack is valid
 } ChessBoardHistory;
 
+// No side can have every square pinned or able to uncover a check, so this can never be a real lazily computed set
+constexpr Bitboard NOT_COMPUTED = ~0ULL;
+
+// Coloured piece as stored in the mailbox: piece type | colour << 3, NO_PIECE for an empty square
+constexpr int PIECE_COLOUR_SHIFT = 3;
+constexpr int PIECE_TYPE_MASK    = 7;
+
+// The bitboards and everything else read on every move fit in the first two cache lines, the mailbox comes last
 typedef struct ChessBoard {
+    Bitboard pieces[PIECE_TYPES]; // Both colours, ALL_PIECES is every occupied square
+    Bitboard colours[COLOURS];
     ChessBoardHistory *history;
-    Bitboard pieces[COLOURS][PIECE_TYPES];
-    PieceType pieceTypes[SQUARES];
+    Square kingSquare[COLOURS];
     Colour sideToMove;
     uint16_t ply; // TODO: Maybe the type
+    uint8_t mailbox[SQUARES];
 } ChessBoard;
 
 // Indexing the same square will return 0. Example: fullLine[e4][e4] == 0
@@ -37,6 +57,18 @@ static inline Key getPositionKey(const ChessBoard *restrict board) {
     return board->history->positionKey;
 }
 
+static inline Key getPawnKey(const ChessBoard *restrict board) {
+    return board->history->pawnKey;
+}
+
+static inline Key getNonPawnKey(const ChessBoard *restrict board, Colour c) {
+    return board->history->nonPawnKey[c];
+}
+
+static inline Key getMaterialKey(const ChessBoard *restrict board) {
+    return board->history->materialKey;
+}
+
 static inline Square getEnPassant(const ChessBoard *restrict board) {
     return board->history->enPassant;
 }
@@ -45,26 +77,60 @@ static inline Bitboard getCheckers(const ChessBoard *restrict board) {
     return board->history->checkers;
 }
 
+Bitboard computePinnedPieces(const ChessBoard *restrict board);
+
+// Pins of the side to move, computed on first use and cached in the history so nodes that never check legality
+// (a stand pat or a cutoff before move generation) skip the slider lookups
+static inline Bitboard getPinnedPieces(const ChessBoard *restrict board) {
+    if (board->history->pinnedPieces == NOT_COMPUTED) board->history->pinnedPieces = computePinnedPieces(board);
+    return board->history->pinnedPieces;
+}
+
 static inline Bitboard getPieces(const ChessBoard *restrict board, Colour c, PieceType pt) {
-    return board->pieces[c][pt];
+    return board->pieces[pt] & board->colours[c];
+}
+
+static inline Bitboard getColourPieces(const ChessBoard *restrict board, Colour c) {
+    return board->colours[c];
 }
 
 static inline Bitboard getBothPieces(const ChessBoard *restrict board, PieceType pt) {
-    return board->pieces[WHITE][pt] | board->pieces[BLACK][pt];
+    return board->pieces[pt];
 }
 
-// TODO: Is it worth having one lookup rather than ORing?
 static inline Bitboard getOccupiedSquares(const ChessBoard *restrict board) {
-    return board->pieces[WHITE][ALL_PIECES] | board->pieces[BLACK][ALL_PIECES];
+    return board->pieces[ALL_PIECES];
 }
 
-// TODO: Is it worth maintaining the king square in struct rather than compute?
 static inline Square getKingSquare(const ChessBoard *restrict board, Colour c) {
-    return bitboardToSquare(getPieces(board, c, KING));
+    return board->kingSquare[c];
+}
+
+static inline uint8_t makePiece(Colour c, PieceType pt) {
+    return pt | c << PIECE_COLOUR_SHIFT;
+}
+
+// The coloured piece on the square, NO_PIECE if it is empty
+static inline uint8_t getPiece(const ChessBoard *restrict board, Square sq) {
+    return board->mailbox[sq];
+}
+
+static inline PieceType getPieceType(const ChessBoard *restrict board, Square sq) {
+    return getPiece(board, sq) & PIECE_TYPE_MASK;
+}
+
+static inline Bitboard attackersTo(const ChessBoard *restrict board, Square sq, Colour attackedSide, Bitboard occupied) {
+    Colour enemy = attackedSide ^ 1;
+    Bitboard queens = getPieces(board, enemy, QUEEN);
+    return (getPawnAttacks(attackedSide, sq) & getPieces(board, enemy, PAWN))
+         | (getNonSliderAttacks(KNIGHT_NON_SLIDER, sq) & getPieces(board, enemy, KNIGHT))
+         | (getSliderAttacks(BISHOP_SLIDER, occupied, sq) & (getPieces(board, enemy, BISHOP) | queens))
+         | (getSliderAttacks(ROOK_SLIDER, occupied, sq) & (getPieces(board, enemy, ROOK)   | queens))
+         | (getNonSliderAttacks(KING_NON_SLIDER, sq) &  getPieces(board, enemy, KING));
 }
 
 static inline bool hasNonPawnMaterial(const ChessBoard *restrict board, Colour c) {
-    return board->pieces[c][ALL_PIECES] ^ board->pieces[c][PAWN] ^ board->pieces[c][KING];
+    return board->colours[c] & ~(board->pieces[PAWN] | board->pieces[KING]);
 }
 
 // TODO: Include more scenarios if necessary
@@ -75,33 +141,49 @@ static inline bool insufficientMaterial(const ChessBoard *restrict board) {
 // TODO: For search, but repetition by history vs repetition by search tree transpose
 // Checks for twofold repetition
 static inline bool isRepetition(const ChessBoard *restrict board) {
-    if (board->history->halfmoveClock >= 4) {
-        Key current = getPositionKey(board);
-        ChessBoardHistory *previous = board->history->previous->previous->previous->previous;
-        if (current == previous->positionKey) return true;
-        for (int count = previous->halfmoveClock; count >= 2; count -= 2) {
-            previous = previous->previous->previous;
-            if (current == previous->positionKey) return true;
-        }
-    }
+    const ChessBoardHistory *current = board->history;
+    int end = min(current->halfmoveClock, current->pliesFromNull);
+    for (int i = 4; i <= end; i += 2)
+        if (current[-i].positionKey == current->positionKey) return true;
     return false;
 }
 
+// Moves the positions that can still repeat to the start of histories, the rest of the stack is discarded
+static inline void compactHistory(ChessBoard *restrict board, ChessBoardHistory *histories) {
+    int length = min(board->history->halfmoveClock, board->history->pliesFromNull) + 1;
+    memmove(histories, board->history - length + 1, length * sizeof(ChessBoardHistory));
+    board->history = histories + length - 1;
+}
+
+// Deep copy, histories becomes the history stack of the destination
+static inline void copyChessBoard(ChessBoard *restrict destination, ChessBoardHistory *histories, const ChessBoard *restrict source) {
+    *destination = *source;
+    compactHistory(destination, histories);
+}
+
 static inline void undoNullMove(ChessBoard *restrict board) {
     board->sideToMove ^= 1;
-    board->history = board->history->previous;
+    board->history--;
 }
 
 void initializeChessBoard();
 
 void parseFEN(ChessBoard *restrict board, ChessBoardHistory *restrict history, Accumulator *restrict accumulator, const char *restrict fen);
+// Rebuilds the accumulator from every piece on the board
+void refreshAccumulator(Accumulator *restrict accumulator, const ChessBoard *restrict board);
 void getFEN(const ChessBoard *restrict board, char *restrict destination);
 
-void makeNullMove(ChessBoard *restrict board, ChessBoardHistory *restrict newState);
-void makeMove(ChessBoard *restrict board, ChessBoardHistory *restrict newState, Accumulator *restrict accumulator, Move move);
+// The new state is pushed to board->history + 1
+void makeNullMove(ChessBoard *restrict board);
+void makeMove(ChessBoard *restrict board, Accumulator *restrict accumulator, Move move);
 void undoMove(ChessBoard *restrict board, Move move);
 bool isDraw(const ChessBoard *restrict board);
+// Approximate position key after the move, used to prefetch
+Key getKeyAfter(const ChessBoard *restrict board, Move move);
+bool hasUpcomingRepetition(const ChessBoard *restrict board, int ply);
 bool isLegalMove(const ChessBoard *restrict board, Move move);
+// Whether the legal move checks the enemy king, decided before the move is made
+bool givesCheck(const ChessBoard *restrict board, Move move);
 bool isPseudoMove(const ChessBoard *restrict board, Move move);
 
 #endif
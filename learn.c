@@ -0,0 +1,283 @@
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "learn.h"
+#include "nnue.h"
+#include "search.h"
+#include "training_data.h"
+#include "utility.h"
+
+constexpr int FEATURES          = COLOURS * (PIECE_TYPES - 1) * SQUARES;
+constexpr int MAX_PIECES        = 32;
+constexpr int SHUFFLE_POSITIONS = 1 << 20; // 32 MB of positions are shuffled at a time
+constexpr int MAX_LEARN_THREADS = 64;
+constexpr float WEIGHT_CLIP     = 1.98f;   // Keeps the quantized output sum inside 32 bits
+constexpr float BETA1           = 0.9f;
+constexpr float BETA2           = 0.999f;
+constexpr float EPSILON         = 1e-8f;
+
+// Float copy of the Network layout, the accumulator weights are indexed by feature
+typedef struct FloatNetwork {
+    float accumulatorWeights[FEATURES][LAYER1];
+    float accumulatorBiases[LAYER1];
+    float outputWeights[LAYER1 * PERSPECTIVE];
+    float outputBias;
+} FloatNetwork;
+
+// Gradients are only accumulated into the rows of the features seen in the thread's share of the batch
+typedef struct LearnThread {
+    FloatNetwork gradients;
+    bool touched[FEATURES];
+    const PackedPosition *positions;
+    size_t count;
+    double loss;
+    pthread_t id;
+} LearnThread;
+
+static FloatNetwork parameters, momentum, velocity;
+static float wdl;
+
+static inline float sigmoid(float x) {
+    return 1.0f / (1.0f + expf(-x));
+}
+
+static inline float clampActivation(float x) {
+    return x < 0.0f ? 0.0f : x > 1.0f ? 1.0f : x;
+}
+
+// Returns the number of pieces, each perspective gets the same features as accumulatorAdd would use
+static int getFeatures(const PackedPosition *restrict position, int features[COLOURS][MAX_PIECES]) {
+    Bitboard occupied = position->occupied;
+    int count = 0;
+    while (occupied) {
+        Square sq = bitboardToSquareWithReset(&occupied);
+        int nibble = position->pieces[count >> 1] >> ((count & 1) * 4) & 0xF;
+        Colour c = nibble >> 3;
+        PieceType pt = (nibble & 7) - 1;
+        features[WHITE][count] = (c       * (PIECE_TYPES - 1) + pt) * SQUARES + (sq ^ FLIP_MASK);
+        features[BLACK][count] = ((c ^ 1) * (PIECE_TYPES - 1) + pt) * SQUARES + sq;
+        count++;
+    }
+    return count;
+}
+
+static void* computeGradients(void *learnThread) {
+    LearnThread *lt = learnThread;
+    FloatNetwork *gradients = &lt->gradients;
+    lt->loss = 0;
+    for (size_t p = 0; p < lt->count; p++) {
+        const PackedPosition *position = &lt->positions[p];
+        int features[COLOURS][MAX_PIECES];
+        int pieces = getFeatures(position, features);
+        Colour stm = position->flags >> 4;
+
+        /* 1) Forward */
+        float hidden[COLOURS][LAYER1];
+        for (Colour c = WHITE; c <= BLACK; c++) {
+            memcpy(hidden[c], parameters.accumulatorBiases, sizeof(hidden[c]));
+            for (int f = 0; f < pieces; f++)
+                for (int i = 0; i < LAYER1; i++) hidden[c][i] += parameters.accumulatorWeights[features[c][f]][i];
+        }
+        float output = parameters.outputBias;
+        for (int i = 0; i < LAYER1; i++) {
+            float us   = clampActivation(hidden[stm    ][i]);
+            float them = clampActivation(hidden[stm ^ 1][i]);
+            output += us * us * parameters.outputWeights[i] + them * them * parameters.outputWeights[i + LAYER1];
+        }
+
+        /* 2) Loss, the data is relative to white while the network is relative to the side to move */
+        float score  = stm ? -position->score : position->score;
+        float result = position->result / 2.0f;
+        if (stm) result = 1.0f - result;
+        float target     = wdl * result + (1.0f - wdl) * sigmoid(score / SCORE_SCALE);
+        float prediction = sigmoid(output);
+        float error      = prediction - target;
+        lt->loss += error * error;
+
+        /* 3) Backward */
+        float outputGradient = 2.0f * error * prediction * (1.0f - prediction);
+        gradients->outputBias += outputGradient;
+        for (int side = 0; side < PERSPECTIVE; side++) {
+            Colour c = side ? stm ^ 1 : stm;
+            float hiddenGradient[LAYER1];
+            for (int i = 0; i < LAYER1; i++) {
+                float activation = clampActivation(hidden[c][i]);
+                gradients->outputWeights[i + side * LAYER1] += outputGradient * activation * activation;
+                hiddenGradient[i] = hidden[c][i] > 0.0f && hidden[c][i] < 1.0f ? outputGradient * parameters.outputWeights[i + side * LAYER1] * 2.0f * activation : 0.0f;
+                gradients->accumulatorBiases[i] += hiddenGradient[i];
+            }
+            for (int f = 0; f < pieces; f++) {
+                lt->touched[features[c][f]] = true;
+                for (int i = 0; i < LAYER1; i++) gradients->accumulatorWeights[features[c][f]][i] += hiddenGradient[i];
+            }
+        }
+    }
+    return nullptr;
+}
+
+static inline void adamUpdate(float *restrict parameter, float *restrict m, float *restrict v, float gradient, float stepSize) {
+    *m = BETA1 * *m + (1.0f - BETA1) * gradient;
+    *v = BETA2 * *v + (1.0f - BETA2) * gradient * gradient;
+    *parameter -= stepSize * *m / (sqrtf(*v) + EPSILON);
+    *parameter = *parameter > WEIGHT_CLIP ? WEIGHT_CLIP : *parameter < -WEIGHT_CLIP ? -WEIGHT_CLIP : *parameter;
+}
+
+// Sums the thread gradients into the first thread, clearing the others as it goes
+static inline float reduceGradient(LearnThread *lt, int threads, float *first) {
+    ptrdiff_t offset = (char *) first - (char *) &lt[0].gradients;
+    float sum = *first;
+    *first = 0.0f;
+    for (int t = 1; t < threads; t++) {
+        float *other = (float *) ((char *) &lt[t].gradients + offset);
+        sum += *other;
+        *other = 0.0f;
+    }
+    return sum;
+}
+
+// Lazy Adam: accumulator rows are only updated for the features that appeared in the batch
+static void applyGradients(LearnThread *lt, int threads, size_t batchSize, float stepSize) {
+    float scale = 1.0f / batchSize;
+    for (int f = 0; f < FEATURES; f++) {
+        bool touched = false;
+        for (int t = 0; t < threads; t++) {
+            touched |= lt[t].touched[f];
+            lt[t].touched[f] = false;
+        }
+        if (!touched) continue;
+        for (int i = 0; i < LAYER1; i++)
+            adamUpdate(&parameters.accumulatorWeights[f][i], &momentum.accumulatorWeights[f][i], &velocity.accumulatorWeights[f][i],
+                       reduceGradient(lt, threads, &lt[0].gradients.accumulatorWeights[f][i]) * scale, stepSize);
+    }
+    for (int i = 0; i < LAYER1; i++)
+        adamUpdate(&parameters.accumulatorBiases[i], &momentum.accumulatorBiases[i], &velocity.accumulatorBiases[i],
+                   reduceGradient(lt, threads, &lt[0].gradients.accumulatorBiases[i]) * scale, stepSize);
+    for (int i = 0; i < LAYER1 * PERSPECTIVE; i++)
+        adamUpdate(&parameters.outputWeights[i], &momentum.outputWeights[i], &velocity.outputWeights[i],
+                   reduceGradient(lt, threads, &lt[0].gradients.outputWeights[i]) * scale, stepSize);
+    adamUpdate(&parameters.outputBias, &momentum.outputBias, &velocity.outputBias,
+               reduceGradient(lt, threads, &lt[0].gradients.outputBias) * scale, stepSize);
+}
+
+static void initializeParameters(bool randomInitialization) {
+    if (randomInitialization) {
+        uint64_t seed = time(nullptr);
+        float *weights = &parameters.accumulatorWeights[0][0];
+        for (int i = 0; i < FEATURES * LAYER1; i++)
+            weights[i] = ((float) (random64BitNumber(&seed) >> 40) / (1 << 24) * 2.0f - 1.0f) / sqrtf(MAX_PIECES);
+        for (int i = 0; i < LAYER1; i++) parameters.accumulatorBiases[i] = 0.0f;
+        for (int i = 0; i < LAYER1 * PERSPECTIVE; i++)
+            parameters.outputWeights[i] = ((float) (random64BitNumber(&seed) >> 40) / (1 << 24) * 2.0f - 1.0f) / sqrtf(LAYER1 * PERSPECTIVE);
+        parameters.outputBias = 0.0f;
+    } else {
+        const Network *network = getNetwork();
+        const int16_t *weights = &network->accumulatorWeights[0][0][0][0];
+        for (int i = 0; i < FEATURES * LAYER1; i++) (&parameters.accumulatorWeights[0][0])[i] = (float) weights[i] / QUANTIZATION_A;
+        for (int i = 0; i < LAYER1; i++) parameters.accumulatorBiases[i] = (float) network->accumulatorBiases[i] / QUANTIZATION_A;
+        for (int i = 0; i < LAYER1 * PERSPECTIVE; i++) parameters.outputWeights[i] = (float) network->outputWeights[i] / QUANTIZATION_B;
+        parameters.outputBias = (float) network->outputBias / (QUANTIZATION_A * QUANTIZATION_B);
+    }
+    memset(&momentum, 0, sizeof(momentum));
+    memset(&velocity, 0, sizeof(velocity));
+}
+
+static inline int16_t quantize(float value, int scale) {
+    return (int16_t) lrintf(value * scale);
+}
+
+// Same padding as the embedded nnue.bin
+static bool saveNetwork(const char *restrict filename) {
+    constexpr int ALIGNMENT = 64;
+    Network *network = calloc(1, sizeof(Network) + ALIGNMENT);
+    int16_t *weights = &network->accumulatorWeights[0][0][0][0];
+    for (int i = 0; i < FEATURES * LAYER1; i++) weights[i] = quantize((&parameters.accumulatorWeights[0][0])[i], QUANTIZATION_A);
+    for (int i = 0; i < LAYER1; i++) network->accumulatorBiases[i] = quantize(parameters.accumulatorBiases[i], QUANTIZATION_A);
+    for (int i = 0; i < LAYER1 * PERSPECTIVE; i++) network->outputWeights[i] = quantize(parameters.outputWeights[i], QUANTIZATION_B);
+    network->outputBias = quantize(parameters.outputBias, QUANTIZATION_A * QUANTIZATION_B);
+
+    FILE *file = fopen(filename, "wb");
+    size_t size = (sizeof(Network) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    bool saved = file && fwrite(network, 1, size, file) == size;
+    if (file) fclose(file);
+    free(network);
+    return saved;
+}
+
+// Splits the batch evenly across the threads, returns the summed loss
+static double trainBatch(LearnThread *lt, int threads, const PackedPosition *positions, size_t batchSize, float stepSize) {
+    size_t share = (batchSize + threads - 1) / threads;
+    int used = 0;
+    for (size_t start = 0; start < batchSize; start += share, used++) {
+        lt[used].positions = positions + start;
+        lt[used].count = start + share < batchSize ? share : batchSize - start;
+        pthread_create(&lt[used].id, nullptr, computeGradients, &lt[used]);
+    }
+    double loss = 0;
+    for (int t = 0; t < used; t++) {
+        pthread_join(lt[t].id, nullptr);
+        loss += lt[t].loss;
+    }
+    applyGradients(lt, used, batchSize, stepSize);
+    return loss;
+}
+
+static void shuffle(PackedPosition *positions, size_t count, uint64_t *restrict seed) {
+    for (size_t i = count - 1; i > 0; i--) {
+        size_t j = random64BitNumber(seed) % (i + 1);
+        PackedPosition temp = positions[i];
+        positions[i] = positions[j];
+        positions[j] = temp;
+    }
+}
+
+bool learn(const LearnConfiguration *restrict config) {
+    TrainingDataReader *reader = malloc(sizeof(TrainingDataReader));
+    if (!openTrainingData(reader, config->dataFile)) {
+        free(reader);
+        return false;
+    }
+    int threads = max(1, min(config->threads, MAX_LEARN_THREADS));
+    LearnThread *lt = calloc(threads, sizeof(LearnThread));
+    PackedPosition *positions = malloc(SHUFFLE_POSITIONS * sizeof(PackedPosition));
+    uint32_t batchSize = max(1, min(config->batchSize, SHUFFLE_POSITIONS));
+    uint64_t seed = time(nullptr);
+    wdl = config->wdl;
+    initializeParameters(config->randomInitialization);
+    printf("info string learning from %s, threads: %d, batch size: %u\n", config->dataFile, threads, batchSize);
+
+    uint64_t step = 0;
+    for (uint32_t epoch = 1; epoch <= config->epochs; epoch++) {
+        // The learning rate drops by 10x for the last quarter of the epochs
+        float learningRate = epoch > config->epochs * 3 / 4 ? config->learningRate / 10 : config->learningRate;
+        uint64_t start = getTimeNs(), seen = 0;
+        double loss = 0;
+        size_t count;
+        rewindTrainingData(reader);
+        do {
+            for (count = 0; count < (size_t) SHUFFLE_POSITIONS && readPackedPosition(reader, &positions[count]); count++);
+            if (count) shuffle(positions, count, &seed);
+            for (size_t batch = 0; batch + batchSize <= count; batch += batchSize) { // A partial batch at the end of a chunk is skipped
+                step++;
+                float stepSize = learningRate * sqrtf(1.0f - powf(BETA2, step)) / (1.0f - powf(BETA1, step));
+                loss += trainBatch(lt, threads, positions + batch, batchSize, stepSize);
+                seen += batchSize;
+            }
+        } while (count == (size_t) SHUFFLE_POSITIONS);
+
+        double seconds = (getTimeNs() - start) / 1e9 + 0.001;
+        bool saved = saveNetwork(config->outputFile);
+        printf("info string epoch %u, loss: %.6f, positions: %llu, positions/sec: %.0lf, network %s %s\n",
+               epoch, seen ? loss / seen : 0.0, seen, seen / seconds, saved ? "saved to" : "could not be saved to", config->outputFile);
+    }
+
+    closeTrainingData(reader);
+    free(positions);
+    free(lt);
+    free(reader);
+    return true;
+}
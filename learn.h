@@ -0,0 +1,21 @@
+#ifndef LEARN_H
+#define LEARN_H
+
+#include <stdint.h>
+
+typedef struct LearnConfiguration {
+    const char *dataFile;
+    const char *outputFile;
+    float learningRate;
+    float wdl; // Weight of the game result in the target, the rest comes from the search score
+    uint32_t epochs;
+    uint32_t batchSize;
+    int threads;
+    bool randomInitialization; // Otherwise training continues from the embedded network
+} LearnConfiguration;
+
+// Trains the network on the data (binary or text) and writes the quantized network after every epoch.
+// Returns false if the data could not be opened.
+bool learn(const LearnConfiguration *restrict config);
+
+#endif
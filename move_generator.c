@@ -15,8 +15,7 @@ static inline MoveObject* generatePromotions(MoveObject *restrict moveList, Squa
     return moveList;
 }
 
-static MoveObject* generatePawnMoves(const ChessBoard *restrict board, MoveObject *restrict moveList, Bitboard validSquares, MoveGenerationStage stage) {
-    Bitboard stmPawns = getPieces(board, board->sideToMove, PAWN);
+static MoveObject* generatePawnMoves(const ChessBoard *restrict board, MoveObject *restrict moveList, Bitboard stmPawns, Bitboard validSquares, MoveGenerationStage stage) {
     Bitboard pawnsOn7thRank = stmPawns & (board->sideToMove ? RANK_2_BB : RANK_7_BB);
     Bitboard pawnsNotOn7thRank = stmPawns ^ pawnsOn7thRank;
 
@@ -49,9 +48,13 @@ static MoveObject* generatePawnMoves(const ChessBoard *restrict board, MoveObjec
             setMove(moveList++, moveSquareInDirection(toSq, -westCaptureDirection), toSq, QUIET);
         }
 
+        // En passant can uncover an attack along the rank of both pawns, so the full legality check is needed
         if (getEnPassant(board) != NO_SQUARE) {
             Bitboard enPassantCapturers = getPawnAttacks(board->sideToMove ^ 1, getEnPassant(board)) & pawnsNotOn7thRank;
-            while (enPassantCapturers) setMove(moveList++, bitboardToSquareWithReset(&enPassantCapturers), getEnPassant(board), EN_PASSANT);
+            while (enPassantCapturers) {
+                setMove(moveList, bitboardToSquareWithReset(&enPassantCapturers), getEnPassant(board), EN_PASSANT);
+                moveList += isLegalMove(board, moveList->move);
+            }
         }
     } else {
         Direction pawnPush = board->sideToMove ? SOUTH : NORTH;
@@ -79,19 +82,49 @@ static MoveObject* generatePawnMoves(const ChessBoard *restrict board, MoveObjec
     return moveList;
 }
 
+// Pinned pieces can only move along the line through their king
 static MoveObject* generatePieceMoves(const ChessBoard *restrict board, MoveObject *restrict moveList, Bitboard validSquares, PieceType pt) {
     Bitboard stmPieces = getPieces(board, board->sideToMove, pt);
     Bitboard occupied = getOccupiedSquares(board);
+    Bitboard pinnedPieces = getPinnedPieces(board);
+    Square kingSquare = getKingSquare(board, board->sideToMove);
     while (stmPieces) {
         Square fromSq = bitboardToSquareWithReset(&stmPieces);
         Bitboard validAttacks = getAttacks(pt, occupied, fromSq) & validSquares;
+        if (pinnedPieces & squareToBitboard(fromSq)) validAttacks &= fullLine[kingSquare][fromSq];
         while (validAttacks) setMove(moveList++, fromSq, bitboardToSquareWithReset(&validAttacks), QUIET);
     }
     return moveList;
 }
 
+// The king may not move to an attacked square, including squares behind it on the line of a checking slider
+static MoveObject* generateKingMoves(const ChessBoard *restrict board, MoveObject *restrict moveList, Bitboard validSquares) {
+    Colour stm = board->sideToMove;
+    Square kingSquare = getKingSquare(board, stm);
+    Bitboard occupied = getOccupiedSquares(board) ^ squareToBitboard(kingSquare);
+    Bitboard validAttacks = getNonSliderAttacks(KING_NON_SLIDER, kingSquare) & validSquares;
+    while (validAttacks) {
+        Square toSq = bitboardToSquareWithReset(&validAttacks);
+        if (!attackersTo(board, toSq, stm, occupied)) setMove(moveList++, kingSquare, toSq, QUIET);
+    }
+    return moveList;
+}
+
+// Pinned pawns can only move along the line through their king
+static MoveObject* generateAllPawnMoves(const ChessBoard *restrict board, MoveObject *restrict moveList, Bitboard validSquares, MoveGenerationStage stage) {
+    Bitboard stmPawns = getPieces(board, board->sideToMove, PAWN);
+    Bitboard pinnedPawns = stmPawns & getPinnedPieces(board);
+    Square kingSquare = getKingSquare(board, board->sideToMove);
+    moveList = generatePawnMoves(board, moveList, stmPawns ^ pinnedPawns, validSquares, stage);
+    while (pinnedPawns) {
+        Square fromSq = bitboardToSquareWithReset(&pinnedPawns);
+        moveList = generatePawnMoves(board, moveList, squareToBitboard(fromSq), validSquares & fullLine[kingSquare][fromSq], stage);
+    }
+    return moveList;
+}
+
 static MoveObject* generateNonKingMoves(const ChessBoard *restrict board, MoveObject *restrict moveList, Bitboard validSquares, MoveGenerationStage stage) {
-    moveList = generatePawnMoves (board, moveList, validSquares, stage );
+    moveList = generateAllPawnMoves(board, moveList, validSquares, stage);
     moveList = generatePieceMoves(board, moveList, validSquares, KNIGHT);
     moveList = generatePieceMoves(board, moveList, validSquares, BISHOP);
     moveList = generatePieceMoves(board, moveList, validSquares, ROOK  );
@@ -99,8 +132,28 @@ static MoveObject* generateNonKingMoves(const ChessBoard *restrict board, MoveOb
     return moveList;
 }
 
+// Generates the captures and the quiet moves in a single pass, in double check only the king can move
+static MoveObject* generateEvasions(const ChessBoard *restrict board, MoveObject *restrict moveList) {
+    Colour stm = board->sideToMove;
+    Bitboard checkers = getCheckers(board);
+    if (populationCount(checkers) == 1) {
+        Bitboard blockSquares = inBetweenLine[getKingSquare(board, stm)][bitboardToSquare(checkers)] & ~getOccupiedSquares(board);
+        Bitboard validSquares = checkers | blockSquares;
+        moveList = generateAllPawnMoves(board, moveList, checkers    , CAPTURES    );
+        moveList = generateAllPawnMoves(board, moveList, blockSquares, NON_CAPTURES);
+        moveList = generatePieceMoves  (board, moveList, validSquares, KNIGHT      );
+        moveList = generatePieceMoves  (board, moveList, validSquares, BISHOP      );
+        moveList = generatePieceMoves  (board, moveList, validSquares, ROOK        );
+        moveList = generatePieceMoves  (board, moveList, validSquares, QUEEN       );
+    }
+    return generateKingMoves(board, moveList, ~getColourPieces(board, stm));
+}
+
 MoveObject* createMoveList(const ChessBoard *restrict board, MoveObject *restrict moveList, MoveGenerationStage stage) {
-    Bitboard validSquares = stage == CAPTURES ? getPieces(board, board->sideToMove ^ 1, ALL_PIECES)
+    if (stage == LEGAL) return createMoveList(board, createMoveList(board, moveList, CAPTURES), NON_CAPTURES);
+    if (stage == EVASIONS) return generateEvasions(board, moveList);
+
+    Bitboard validSquares = stage == CAPTURES ? getColourPieces(board, board->sideToMove ^ 1)
                                               : ~getOccupiedSquares(board);
     Bitboard checkers = getCheckers(board);
     if (!checkers) {
@@ -108,7 +161,7 @@ MoveObject* createMoveList(const ChessBoard *restrict board, MoveObject *restric
         if (stage == NON_CAPTURES) moveList = generateCastleMoves(board, moveList);
     } else if (populationCount(checkers) == 1)
         moveList = generateNonKingMoves(board, moveList, validSquares & inBetweenLine[getKingSquare(board, board->sideToMove)][bitboardToSquare(checkers)], stage);
-    return generatePieceMoves(board, moveList, validSquares, KING);
+    return generateKingMoves(board, moveList, validSquares);
 }
 
 MoveObject* generateCastleMoves(const ChessBoard *restrict board, MoveObject *restrict moveList) {
@@ -121,8 +174,10 @@ MoveObject* generateCastleMoves(const ChessBoard *restrict board, MoveObject *re
         const Square toSquare[CASTLING_SIDES][COLOURS] = {{G1, G8}, {C1, C8}};
         const CastlingRights cr[CASTLING_SIDES] = {KINGSIDE, QUEENSIDE};
         for (size_t i = 0; i < CASTLING_SIDES; i++) { // First kingside, then queenside.
-            if ((cr[i] & stmRights) && isPathClear(castlePathStartSquare[i][stm], knightSquare[i][stm], getOccupiedSquares(board))) 
-                setMove(moveList++, getKingSquare(board, stm), toSquare[i][stm], CASTLE); // +2 == offset to convert to MoveType == KINGSIDE_CASTLE/QUEENSIDE_CASTLE
+            if ((cr[i] & stmRights) && isPathClear(castlePathStartSquare[i][stm], knightSquare[i][stm], getOccupiedSquares(board))) {
+                setMove(moveList, getKingSquare(board, stm), toSquare[i][stm], CASTLE); // +2 == offset to convert to MoveType == KINGSIDE_CASTLE/QUEENSIDE_CASTLE
+                moveList += isLegalMove(board, moveList->move); // The king may not pass through an attacked square
+            }
         }
     }
     return moveList;
@@ -130,9 +185,5 @@ MoveObject* generateCastleMoves(const ChessBoard *restrict board, MoveObject *re
 
 bool anyLegalMoves(const ChessBoard *restrict board) {
     MoveObject moveList[MAX_MOVES];
-    MoveObject *endList = createMoveList(board, moveList, CAPTURES);
-    endList = createMoveList(board, endList, NON_CAPTURES);
-    for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) 
-        if (isLegalMove(board, moveObj->move)) return true;
-    return false;
+    return createMoveList(board, moveList, LEGAL) != moveList;
 }
@@ -4,9 +4,10 @@
 #include "chess_board.h"
 #include "utility.h"
 
-// TODO: Legal move generation stage
+// Every stage only generates legal moves, LEGAL generates the captures followed by the non captures.
+// EVASIONS must only be used in check: king moves, captures of the checker and interpositions.
 typedef enum MoveGenerationStage {
-    CAPTURES, NON_CAPTURES, LEGAL
+    CAPTURES, NON_CAPTURES, LEGAL, EVASIONS
 } MoveGenerationStage;
 
 MoveObject* createMoveList(const ChessBoard *restrict board, MoveObject *restrict moveList, MoveGenerationStage stage);
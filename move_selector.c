@@ -13,9 +13,9 @@ static inline void swap(MoveObject *mo1, MoveObject *mo2) {
 static void scoreMoves(const ChessBoard *restrict board, MoveSelector *restrict ms) {
     MoveObject *startList = ms->startList;
     while (startList < ms->endList) {
-        PieceType capturedPiece = board->pieceTypes[getToSquare(startList->move)];
+        PieceType capturedPiece = getPieceType(board, getToSquare(startList->move));
         if (capturedPiece) {
-            startList->score = PIECE_VALUE[capturedPiece] - board->pieceTypes[getFromSquare(startList->move)]; // MVV/LVA
+            startList->score = PIECE_VALUE[capturedPiece] - getPieceType(board, getFromSquare(startList->move)); // MVV/LVA
         } else if (getMoveType(startList->move) & EN_PASSANT) {
             startList->score = 90;
         } else {
@@ -38,6 +38,8 @@ Move getNextBestMove(const ChessBoard *restrict board, MoveSelector *restrict ms
     while (true) {
         switch (ms->state) {
             case TT_MOVE:
+            case Q_SEARCH_TT_MOVE:
+            case EVASION_TT_MOVE:
                 ms->state++;
                 return ms->ttMove;
             case Q_SEARCH_CAPTURE_MOVES:
@@ -59,7 +61,13 @@ Move getNextBestMove(const ChessBoard *restrict board, MoveSelector *restrict ms
                 scoreMoves(board, ms);
                 break;
             case GET_NON_CAPTURE_MOVES:
+            case GET_EVASIONS:
                 return getNextHighestScoringMove(ms);
+            case EVASION_MOVES:
+                ms->state++;
+                ms->endList = createMoveList(board, ms->moveList, EVASIONS);
+                scoreMoves(board, ms);
+                break;
             default:
                 return NO_MOVE;
         }
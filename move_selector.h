@@ -11,6 +11,11 @@ typedef enum MoveSelectorState {
     NON_CAPTURE_MOVES, 
     GET_NON_CAPTURE_MOVES,
      
+    EVASION_TT_MOVE,
+    EVASION_MOVES,
+    GET_EVASIONS,
+
+    Q_SEARCH_TT_MOVE,
     Q_SEARCH_CAPTURE_MOVES,
     Q_SEARCH_GET_CAPTURES
 } MoveSelectorState;
@@ -23,7 +28,9 @@ typedef struct MoveSelector {
     Move ttMove;
 } MoveSelector;
 
+// In check every search uses the evasion stages instead of the requested ones
 static inline void createMoveSelector(MoveSelector *restrict ms, const ChessBoard *restrict board, MoveSelectorState state, Move ttMove) {
+    if (getCheckers(board)) state = EVASION_TT_MOVE;
     ms->state = state + !(ttMove && isPseudoMove(board, ttMove));
     ms->ttMove = ttMove;
     ms->startList = ms->moveList;
@@ -2,26 +2,16 @@
 #include "nnue.h"
 #include "utility.h"
 
-constexpr int FLIP_MASK       = 0b111000;
-constexpr int SCORE_SCALE     =      400;
-constexpr int QUANTIZATION_A  =      255;
-constexpr int QUANTIZATION_B  =       64;
-constexpr int PERSPECTIVE     =        2;
-
-typedef struct Network {
-    int16_t accumulatorWeights[COLOURS][PIECE_TYPES - 1][SQUARES][LAYER1];
-    int16_t accumulatorBiases[LAYER1];
-
-    int16_t outputWeights[LAYER1 * PERSPECTIVE];
-    int16_t outputBias;
-} Network;
-
 static const uint8_t networkData[] = {
     #embed "nnue.bin"
 };
 
 static const Network *network = (const Network *) networkData;
 
+const Network* getNetwork() {
+    return network;
+}
+
 static inline int32_t SCReLU(int16_t val) {
     int16_t clamped = val >= QUANTIZATION_A ? QUANTIZATION_A
                     : val >  0              ? val
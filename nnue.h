@@ -4,12 +4,28 @@
 #include <stdint.h>
 #include "utility.h"
 
-constexpr int LAYER1 = 128;
+constexpr int LAYER1          =      128;
+constexpr int FLIP_MASK       = 0b111000;
+constexpr int SCORE_SCALE     =      400;
+constexpr int QUANTIZATION_A  =      255;
+constexpr int QUANTIZATION_B  =       64;
+constexpr int PERSPECTIVE     =        2;
+
+// Layout of nnue.bin
+typedef struct Network {
+    int16_t accumulatorWeights[COLOURS][PIECE_TYPES - 1][SQUARES][LAYER1];
+    int16_t accumulatorBiases[LAYER1];
+
+    int16_t outputWeights[LAYER1 * PERSPECTIVE];
+    int16_t outputBias;
+} Network;
 
 typedef struct Accumulator {
     int16_t accumulator[COLOURS][LAYER1];
 } Accumulator;
 
+const Network* getNetwork();
+
 void accumulatorReset(Accumulator *restrict accumulator);
 // Adds a piece to the accumulator, always using the perspective of white.
 void accumulatorAdd(Accumulator *restrict accumulator, Colour c, PieceType pt, Square sq);
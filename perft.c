@@ -0,0 +1,141 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "perft.h"
+#include "chess_board.h"
+#include "move_generator.h"
+#include "utility.h"
+
+typedef struct PerftThread {
+    ChessBoard board;
+    ChessBoardHistory histories[MAX_HISTORY];
+    const MoveObject *rootMoves;
+    uint64_t *rootNodes;
+    atomic_int *nextRootMove;
+    PerftTable *table;
+    pthread_t id;
+    int rootMovesCount;
+    Depth depth;
+} PerftThread;
+
+void createPerftTable(PerftTable *restrict table, size_t mb) {
+    *table = (PerftTable) {0};
+    size_t numberOfEntries = mb * 1024 * 1024 / sizeof(PerftEntry); // Convert megabytes to bytes first
+    if (!numberOfEntries) return;
+
+    // Rounds down to the nearest largest power of 2
+    numberOfEntries = squareToBitboard(bitboardToSquareMSB(numberOfEntries));
+    table->entries = calloc(numberOfEntries, sizeof(PerftEntry));
+    table->mask = numberOfEntries - 1;
+}
+
+void destroyPerftTable(PerftTable *restrict table) {
+    free(table->entries);
+    *table = (PerftTable) {0};
+}
+
+static inline bool probePerftTable(const PerftTable *table, Key positionKey, Depth depth, uint64_t *restrict nodes) {
+    if (!table->entries) return false;
+    PerftEntry *entry = &table->entries[positionKey & table->mask];
+    uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    uint64_t key  = atomic_load_explicit(&entry->keyXorData, memory_order_relaxed) ^ data;
+    if (key != positionKey || (Depth) data != depth) return false;
+    *nodes = data >> 8;
+    return true;
+}
+
+// Always replace
+static inline void savePerftTable(PerftTable *table, Key positionKey, Depth depth, uint64_t nodes) {
+    if (!table->entries) return;
+    PerftEntry *entry = &table->entries[positionKey & table->mask];
+    uint64_t data = nodes << 8 | depth;
+    atomic_store_explicit(&entry->keyXorData, positionKey ^ data, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
+
+static uint64_t perftRecursive(ChessBoard *restrict board, Depth depth, PerftTable *table) {
+    uint64_t nodes = 0;
+    Key positionKey = getPositionKey(board);
+    if (depth > 1 && probePerftTable(table, positionKey, depth, &nodes)) return nodes;
+
+    // Only legal moves are generated, so the leaves are counted in bulk
+    MoveObject moveList[MAX_MOVES];
+    MoveObject *endList = createMoveList(board, moveList, getCheckers(board) ? EVASIONS : LEGAL);
+    if (depth == 1) nodes = endList - moveList;
+    else {
+        for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) {
+            Move move = moveObj->move;
+            makeMove(board, nullptr, move);
+            nodes += perftRecursive(board, depth - 1, table);
+            undoMove(board, move);
+        }
+        savePerftTable(table, positionKey, depth, nodes);
+    }
+    return nodes;
+}
+
+static void* startPerftThread(void *perftThread) {
+    PerftThread *pt = perftThread;
+    int i;
+    while ((i = atomic_fetch_add_explicit(pt->nextRootMove, 1, memory_order_relaxed)) < pt->rootMovesCount) {
+        Move move = pt->rootMoves[i].move;
+        makeMove(&pt->board, nullptr, move);
+        pt->rootNodes[i] = pt->depth > 1 ? perftRecursive(&pt->board, pt->depth - 1, pt->table) : 1;
+        undoMove(&pt->board, move);
+    }
+    return nullptr;
+}
+
+uint64_t perft(const ChessBoard *restrict board, Depth depth, int threads, PerftTable *table, bool divide) {
+    if (!depth) return 1;
+
+    MoveObject rootMoves[MAX_MOVES];
+    int rootMovesCount = createMoveList(board, rootMoves, LEGAL) - rootMoves;
+
+    uint64_t rootNodes[MAX_MOVES];
+    atomic_int nextRootMove = 0;
+    threads = max(1, min(threads, rootMovesCount));
+    PerftThread *pth = malloc(threads * sizeof(PerftThread));
+    for (int i = 0; i < threads; i++) {
+        pth[i] = (PerftThread) {
+            .rootMoves = rootMoves, .rootNodes = rootNodes, .nextRootMove = &nextRootMove,
+            .table = table, .rootMovesCount = rootMovesCount, .depth = depth
+        };
+        copyChessBoard(&pth[i].board, pth[i].histories, board);
+        pthread_create(&pth[i].id, nullptr, startPerftThread, &pth[i]);
+    }
+    for (int i = 0; i < threads; i++) pthread_join(pth[i].id, nullptr);
+    free(pth);
+
+    uint64_t nodes = 0;
+    for (int i = 0; i < rootMovesCount; i++) {
+        nodes += rootNodes[i];
+        if (divide) {
+            char moveString[6];
+            moveToString(moveString, rootMoves[i].move);
+            printf("%s: %llu\n", moveString, rootNodes[i]);
+        }
+    }
+    return nodes;
+}
+
+uint64_t boardBenchmark(const ChessBoard *restrict board, uint64_t iterations) {
+    ChessBoard copy;
+    ChessBoardHistory histories[MAX_HISTORY];
+    copyChessBoard(&copy, histories, board);
+
+    uint64_t moves = 0;
+    MoveObject moveList[MAX_MOVES];
+    for (uint64_t i = 0; i < iterations; i++) {
+        MoveObject *endList = createMoveList(&copy, moveList, getCheckers(&copy) ? EVASIONS : LEGAL);
+        for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) {
+            makeMove(&copy, nullptr, moveObj->move);
+            undoMove(&copy, moveObj->move);
+        }
+        moves += endList - moveList;
+    }
+    return moves;
+}
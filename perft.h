@@ -0,0 +1,32 @@
+#ifndef PERFT_H
+#define PERFT_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "chess_board.h"
+#include "utility.h"
+
+// Lockless entry: a torn write from another thread fails the key check instead of returning a wrong count
+typedef struct PerftEntry {
+    _Atomic uint64_t keyXorData;
+    _Atomic uint64_t data; // Nodes << 8 | Depth
+} PerftEntry;
+
+typedef struct PerftTable {
+    PerftEntry *entries;
+    uint64_t mask;
+} PerftTable;
+
+// A size of 0 megabytes disables the table
+void createPerftTable(PerftTable *restrict table, size_t mb);
+void destroyPerftTable(PerftTable *restrict table);
+
+// Splits the root moves across threads, the table can be shared between calls. Divide prints the nodes of each root move.
+uint64_t perft(const ChessBoard *restrict board, Depth depth, int threads, PerftTable *table, bool divide);
+
+// Micro-benchmark of the board itself: generates the legal moves and makes and undoes each of them, repeated iterations times.
+// Returns the number of moves made.
+uint64_t boardBenchmark(const ChessBoard *restrict board, uint64_t iterations);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef POLYGLOT_H
+#define POLYGLOT_H
+
+#include <stdint.h>
+#include "chess_board.h"
+#include "utility.h"
+
+// Memory-maps the book, any previously opened book is closed. Returns false if the file is missing or corrupted.
+bool openBook(const char *restrict filename);
+void closeBook();
+
+Key getPolyglotKey(const ChessBoard *restrict board);
+
+// Picks a legal book move at random, weighted by the entry weights. Returns NO_MOVE if the position is not in the book.
+Move probeBook(const ChessBoard *restrict board, uint64_t *restrict seed);
+
+#endif
@@ -1,14 +1,22 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "search.h"
 #include "chess_board.h"
 #include "utility.h"
 #include "transposition_table.h"
 #include "move_selector.h"
+#include "move_generator.h"
 #include "nnue.h"
+#include "syzygy.h"
 
-constexpr Depth MAX_DEPTH = 255;
+constexpr Score TABLEBASE_WIN = GUARANTEE_CHECKMATE - MAX_DEPTH - 1;
+constexpr int CORRECTION_GRAIN        = 256; // Corrections are stored in 1/256ths of a centipawn
+constexpr int CORRECTION_BONUS_SCALE  = 64;
+constexpr int CORRECTION_MAX          = CORRECTION_GRAIN * 64; // Per table, still fits an int16_t entry
+constexpr Score PROBCUT_MARGIN        = 200;
 
 typedef enum Node {
     ROOT, PV, NON_PV
@@ -16,10 +24,9 @@ typedef enum Node {
 
 typedef struct SearchHelper {
     Move pv[MAX_DEPTH]; // TODO: Is it worth saving space by making triangular?
+    Move excludedMove; // Skipped by the singular extension verification search of this ply
 } SearchHelper;
 
-static Accumulator accumulator[(MAX_DEPTH + 1) * 2]; // TODO: Where to store accumulator and sizing
-
 static inline void updatePV(Move move, Move *restrict currentPV, const Move *restrict childrenPV) {
     *currentPV++ = move;
     while((*currentPV++ = *childrenPV++));
@@ -40,7 +47,7 @@ static inline void pvToString(char *restrict pvStr, char *restrict bestMove, cha
 
 // A move is considered interesting if it is a capture move or a Queen promotion
 static inline bool isInteresting(const ChessBoard *restrict board, Move move) {
-    return board->pieceTypes[getToSquare(move)] || getMoveType(move) == EN_PASSANT || getMoveType(move) == QUEEN_PROMOTION;
+    return getPiece(board, getToSquare(move)) || getMoveType(move) == EN_PASSANT || getMoveType(move) == QUEEN_PROMOTION;
 }
 
 // TODO: Ensure our static evaluation after scaled cannot return a false checkmate
@@ -53,15 +60,67 @@ static inline Score getRFPMargin(Depth depth) {
     return 150 * depth;
 }
 
+static inline Score getRazoringMargin(Depth depth) {
+    return 250 + 200 * depth;
+}
+
+static inline bool isExcludedRootMove(const SearchThread *st, Move move) {
+    bool isRootMove = !st->rootMovesCount;
+    for (int i = 0; i < st->rootMovesCount; i++) isRootMove |= st->rootMoves[i] == move;
+    if (!isRootMove) return true;
+    for (int i = 0; i < st->pvIndex; i++)
+        if (st->pvLines[i].bestMove.move == move) return true;
+    return false;
+}
+
+// Stable insertion sort by score, so lines with equal scores keep their search order
+static void sortPVLines(PVLine *pvLines, int count) {
+    for (int i = 1; i < count; i++) {
+        PVLine line = pvLines[i];
+        int j = i;
+        for (; j > 0 && pvLines[j - 1].bestMove.score < line.bestMove.score; j--) pvLines[j] = pvLines[j - 1];
+        pvLines[j] = line;
+    }
+}
+
+static int countLegalMoves(const ChessBoard *restrict board) {
+    MoveObject moveList[MAX_MOVES];
+    return createMoveList(board, moveList, LEGAL) - moveList;
+}
+
 // TODO: Should eventually include seldepth
-static inline void printSearch(Depth depth, Score score, const char *restrict pvString, const SearchThread *st) {
+static inline void printSearch(Depth depth, int multiPV, Score score, const char *restrict pvString, const SearchThread *st) {
     uint64_t time = (getTimeNs() - st->startNs) / 1000000;
     uint64_t nps = st->nodes * 1000 / (time + 1);
     char *scoreType = score >= GUARANTEE_CHECKMATE || score <= -GUARANTEE_CHECKMATE ? "mate" : "cp";
     score = score >=  GUARANTEE_CHECKMATE ? ( CHECKMATE - score + 1) / 2
           : score <= -GUARANTEE_CHECKMATE ? (-CHECKMATE - score    ) / 2
           : score;
-    printf("info depth %d score %s %d nodes %llu nps %llu time %llu pv %s\n", depth, scoreType, score, st->nodes, nps, time, pvString);
+    printf("info depth %d multipv %d score %s %d nodes %llu nps %llu tbhits %llu time %llu pv %s\n", depth, multiPV, scoreType, score, st->nodes, nps, st->tbHits, time, pvString);
+}
+
+static inline Score correctEvaluation(const SearchThread *st, Score rawEvaluation) {
+    const ChessBoard *board = &st->board;
+    int correction = st->pawnCorrection    [board->sideToMove][getPawnKey    (board) & (CORRECTION_HISTORY_SIZE - 1)]
+                   + st->materialCorrection[board->sideToMove][getMaterialKey(board) & (CORRECTION_HISTORY_SIZE - 1)];
+    return max(-TABLEBASE_WIN + 1, min(rawEvaluation + correction / CORRECTION_GRAIN, TABLEBASE_WIN - 1));
+}
+
+// The error left after correction is added on, so the entries keep moving until the corrected evaluation stops missing
+// The gravity term shrinks the bonus as an entry nears CORRECTION_MAX, which keeps it in range
+static inline void updateCorrection(int16_t *entry, int bonus) {
+    *entry += bonus - *entry * abs(bonus) / CORRECTION_MAX;
+}
+
+// Only scores that say more than the bound allows are learned from: a fail high above or a fail low below the evaluation
+static inline void updateCorrectionHistory(SearchThread *st, Score bestScore, Score staticEvaluation, Bound bound, Depth depth) {
+    const ChessBoard *board = &st->board;
+    if (bestScore >= TABLEBASE_WIN || bestScore <= -TABLEBASE_WIN) return;
+    if ((bound == LOWER && bestScore <= staticEvaluation) || (bound == UPPER && bestScore >= staticEvaluation)) return;
+    int error = (bestScore - staticEvaluation) * CORRECTION_GRAIN;
+    int bonus = max(-CORRECTION_MAX / 4, min(error * min(depth + 1, 16) / CORRECTION_BONUS_SCALE, CORRECTION_MAX / 4));
+    updateCorrection(&st->pawnCorrection    [board->sideToMove][getPawnKey    (board) & (CORRECTION_HISTORY_SIZE - 1)], bonus);
+    updateCorrection(&st->materialCorrection[board->sideToMove][getMaterialKey(board) & (CORRECTION_HISTORY_SIZE - 1)], bonus);
 }
 
 static Score quiescenceSearch(Score alpha, Score beta, SearchHelper *restrict sh, SearchThread *st) {
@@ -70,48 +129,90 @@ static Score quiescenceSearch(Score alpha, Score beta, SearchHelper *restrict sh
 
     /* 1) Draw Detection */
     if (isDraw(board)) return DRAW;
+    if (alpha < DRAW && hasUpcomingRepetition(board, st->ply)) {
+        alpha = DRAW;
+        if (alpha >= beta) return alpha;
+    }
     /*                   */
+
+    /* 2) Transposition Table */
+    // Every entry is at least as deep as quiescence search, so any bound that applies is a cutoff
+    bool hasEvaluation = false;
+    Key positionKey = getPositionKey(board);
+    PositionEvaluation *pe = st->ignoreTT ? nullptr : probeTranspositionTable(st->tt, positionKey, &hasEvaluation);
+    Move ttMove = NO_MOVE;
+    if (hasEvaluation) {
+        Bound bound = getBound(pe);
+        Score nodeScore = adjustNodeScoreFromTT(pe->nodeScore, st->ply);
+        if (bound == EXACT || (bound == LOWER ? nodeScore >= beta : nodeScore <= alpha)) return nodeScore;
+        ttMove = pe->bestMove;
+    }
+    /*                        */
     
     bool checkers = getCheckers(board);
-    const Accumulator *currentAccumulator = &accumulator[st->ply    ];
-    Accumulator       *childAccumulator   = &accumulator[st->ply + 1];
+    const Accumulator *currentAccumulator = &st->accumulators[st->ply    ];
+    Accumulator       *childAccumulator   = &st->accumulators[st->ply + 1];
     /* Stand Pat */
-    Score bestScore = checkers ? -CHECKMATE + st->ply : evaluation(currentAccumulator, board->sideToMove); // TODO: Could be evaluating a stalemate
+    Score staticEvaluation = checkers ? -INFINITE 
+                           : hasEvaluation ? pe->staticEvaluation
+                           : evaluation(currentAccumulator, board->sideToMove);
+    Score bestScore = checkers ? -CHECKMATE + st->ply : staticEvaluation; // TODO: Could be evaluating a stalemate
+    Score oldAlpha = alpha;
+    Move bestMove = NO_MOVE;
     if (bestScore > alpha) {
-        if (bestScore >= beta) return bestScore; 
+        if (bestScore >= beta) {
+            if (pe) savePositionEvaluation(st->tt, pe, positionKey, NO_MOVE, 0, LOWER, adjustNodeScoreToTT(bestScore, st->ply), staticEvaluation);
+            return bestScore; 
+        }
         alpha = bestScore;
     }
     /*           */
 
     /* Main Moves Loop */
-    ChessBoardHistory history;
+    // Out of check only a capture or queen promotion from the TT is searched, a quiet TT move is left to the main search
+    if (!checkers && ttMove && !isInteresting(board, ttMove)) ttMove = NO_MOVE;
     MoveSelector ms;
-    MoveSelectorState state = checkers ? TT_MOVE : GET_NON_CAPTURE_MOVES; // TODO: Cleanup naming
-    createMoveSelector(&ms, board, state, NO_MOVE);
+    createMoveSelector(&ms, board, Q_SEARCH_TT_MOVE, ttMove);
 
     Move move;
     while ((move = getNextBestMove(board, &ms))) {
-        if (!isLegalMove(board, move)) continue;
-        
+        if (!st->ignoreTT) prefetchTranspositionTable(st->tt, getKeyAfter(board, move));
         st->ply++;
         *childAccumulator = *currentAccumulator;
-        makeMove(board, &history, childAccumulator, move);
+        makeMove(board, childAccumulator, move);
         Score score = -quiescenceSearch(-beta, -alpha, sh, st);
         undoMove(board, move);
         st->ply--;
         
         if (score > bestScore) {
+            bestScore = score;
+            bestMove = move;
             if (score > alpha) {
-                if (score >= beta) return score;
+                if (score >= beta) break;
                 alpha = score; 
             }
-            bestScore = score;
         }
     }
     /*                 */
+
+    if (pe) {
+        Bound bound = bestScore >= beta ? LOWER : bestScore > oldAlpha ? EXACT : UPPER;
+        savePositionEvaluation(st->tt, pe, positionKey, bestMove, 0, bound, adjustNodeScoreToTT(bestScore, st->ply), staticEvaluation);
+    }
     return bestScore;
 }
 
+// The root position must not be in check
+// The TT is left out so the score only depends on the position, not on what earlier searches stored
+Score quiescenceEvaluation(SearchThread *st) {
+    SearchHelper sh = {0};
+    st->ply = 0;
+    st->ignoreTT = true;
+    Score score = quiescenceSearch(-INFINITE, INFINITE, &sh, st);
+    st->ignoreTT = false;
+    return score;
+}
+
 static Score alphaBeta(Score alpha, Score beta, Depth depth, Node node, SearchHelper *restrict sh, SearchThread *st) {
     sh->pv[0] = NO_MOVE;
 
@@ -123,6 +224,11 @@ static Score alphaBeta(Score alpha, Score beta, Depth depth, Node node, SearchHe
     st->nodes++;
     /* 2) Draw Detection */
     if ((node != ROOT && isDraw(board)) || outOfTime(st)) return DRAW;
+    // The side to move can force a repetition, so the node is worth at least a draw
+    if (node != ROOT && alpha < DRAW && hasUpcomingRepetition(board, st->ply)) {
+        alpha = DRAW;
+        if (alpha >= beta) return alpha;
+    }
     /*                   */
 
     /* 3) Transposition Table */
@@ -130,42 +236,107 @@ static Score alphaBeta(Score alpha, Score beta, Depth depth, Node node, SearchHe
     bool hasEvaluation;
     Key positionKey = getPositionKey(board);
     PositionEvaluation *pe = probeTranspositionTable(st->tt, positionKey, &hasEvaluation);
+    const Move excludedMove = sh->excludedMove;
     Move ttMove = NO_MOVE;
+    Score ttScore = -INFINITE;
+    Depth ttDepth = 0;
+    Bound ttBound = UPPER;
     if (hasEvaluation) {
-        if (!isPvNode && pe->depth >= depth) {
-            Bound bound = getBound(pe);
-            Score nodeScore = adjustNodeScoreFromTT(pe->nodeScore, st->ply);
-            if (bound == EXACT || (bound == LOWER ? nodeScore >= beta : nodeScore <= alpha)) return nodeScore;
-        }
-        ttMove = pe->bestMove;
+        // The entry is read once, the singular extension search below may replace it
+        ttMove  = pe->bestMove;
+        ttScore = adjustNodeScoreFromTT(pe->nodeScore, st->ply);
+        ttDepth = pe->depth;
+        ttBound = getBound(pe);
+        // The entry belongs to the search with every move, not the one without the excluded move
+        if (!isPvNode && !excludedMove && ttDepth >= depth && (ttBound == EXACT || (ttBound == LOWER ? ttScore >= beta : ttScore <= alpha))) return ttScore;
     }
     /*                        */
 
-    ChessBoardHistory history;
     SearchHelper *child = sh + 1;
-    const Accumulator *currentAccumulator = &accumulator[st->ply    ];
-    Accumulator       *childAccumulator   = &accumulator[st->ply + 1];
+    const Accumulator *currentAccumulator = &st->accumulators[st->ply    ];
+    Accumulator       *childAccumulator   = &st->accumulators[st->ply + 1];
 
     bool checkers = getCheckers(board);
-    Score staticEvaluation = checkers ? -INFINITE 
-                           : hasEvaluation ? pe->staticEvaluation
-                           : evaluation(currentAccumulator, board->sideToMove);
-    /** 4) Null Move Pruning **/
-    if (!isPvNode && !checkers && depth > 3 && staticEvaluation >= beta && hasNonPawnMaterial(board, board->sideToMove)) {
+    Score rawEvaluation = checkers ? -INFINITE 
+                        : hasEvaluation ? pe->staticEvaluation
+                        : evaluation(currentAccumulator, board->sideToMove);
+    Score staticEvaluation = checkers ? -INFINITE : correctEvaluation(st, rawEvaluation);
+
+    /* 4) Tablebase Probing */
+    if (node != ROOT && !excludedMove && !board->history->halfmoveClock && !board->history->castlingRights && populationCount(getOccupiedSquares(board)) <= largestTablebase) {
+        ProbeState result;
+        WDLScore wdl = probeWDL(board, &result);
+        if (result != PROBE_FAIL) {
+            st->tbHits++;
+            Score tbScore = wdl < WDL_BLESSED_LOSS ? -TABLEBASE_WIN + st->ply
+                          : wdl > WDL_CURSED_WIN   ?  TABLEBASE_WIN - st->ply
+                          : DRAW;
+            Bound bound = wdl < WDL_BLESSED_LOSS ? UPPER : wdl > WDL_CURSED_WIN ? LOWER : EXACT;
+            if (bound == EXACT || (bound == LOWER ? tbScore >= beta : tbScore <= alpha)) {
+                savePositionEvaluation(st->tt, pe, positionKey, NO_MOVE, min(depth + 6, MAX_DEPTH), bound, adjustNodeScoreToTT(tbScore, st->ply), rawEvaluation);
+                return tbScore;
+            }
+        }
+    }
+    /*                      */
+
+    /** 5) Razoring **/
+    // Far below alpha at low depth only a capture could save the node, so quiescence search decides
+    if (!isPvNode && !checkers && !excludedMove && depth <= 3 && staticEvaluation + getRazoringMargin(depth) <= alpha) {
+        Score score = quiescenceSearch(alpha, beta, sh, st);
+        if (score <= alpha) return score;
+    }
+    /**             **/
+
+    /** 6) Null Move Pruning **/
+    // The reduction grows with depth and with how far the evaluation is above beta
+    if (!isPvNode && !checkers && !excludedMove && depth > 3 && staticEvaluation >= beta && hasNonPawnMaterial(board, board->sideToMove)) {
+        int reduction = min(3 + depth / 4 + min((staticEvaluation - beta) / 200, 3), depth);
         st->ply++;
         *childAccumulator = *currentAccumulator;
-        makeNullMove(board, &history);
-        Score score = -alphaBeta(-beta, -beta + 1, depth - 4, NON_PV, child, st);
+        makeNullMove(board);
+        Score score = -alphaBeta(-beta, -beta + 1, depth - reduction, NON_PV, child, st);
         undoNullMove(board);
         st->ply--;
         if (score >= beta) return score;
     }
     /**                      **/
 
-    /** 5) Reverse Futility Pruning **/
-    if (!isPvNode && !checkers && staticEvaluation - getRFPMargin(depth) >= beta) return staticEvaluation;
+    /** 7) Reverse Futility Pruning **/
+    if (!isPvNode && !checkers && !excludedMove && staticEvaluation - getRFPMargin(depth) >= beta) return staticEvaluation;
     /**                             **/
 
+    /** 8) ProbCut **/
+    // A capture that beats beta by a margin in a reduced search very likely beats beta in the full search.
+    // Quiescence search first filters the captures that do not even hold their material.
+    Score probCutBeta = beta + PROBCUT_MARGIN;
+    if (!isPvNode && !checkers && !excludedMove && depth >= 5 && beta > -TABLEBASE_WIN && beta < TABLEBASE_WIN
+        && !(ttDepth + 3 >= depth && ttScore < probCutBeta)) {
+        MoveSelector ms;
+        createMoveSelector(&ms, board, Q_SEARCH_TT_MOVE, ttMove && isInteresting(board, ttMove) ? ttMove : NO_MOVE);
+        Move move;
+        while ((move = getNextBestMove(board, &ms))) {
+            prefetchTranspositionTable(st->tt, getKeyAfter(board, move));
+            st->ply++;
+            *childAccumulator = *currentAccumulator;
+            makeMove(board, childAccumulator, move);
+            Score score = -quiescenceSearch(-probCutBeta, -probCutBeta + 1, child, st);
+            if (score >= probCutBeta) score = -alphaBeta(-probCutBeta, -probCutBeta + 1, depth - 4, NON_PV, child, st);
+            undoMove(board, move);
+            st->ply--;
+            if (score >= probCutBeta) {
+                if (!st->stop) savePositionEvaluation(st->tt, pe, positionKey, move, depth - 3, LOWER, adjustNodeScoreToTT(score, st->ply), rawEvaluation);
+                return score;
+            }
+        }
+    }
+    /**            **/
+
+    /** 9) Internal Iterative Reductions **/
+    // Without a TT move the moves are poorly ordered, so the node is searched shallower and the next iteration has a TT move
+    if (node != ROOT && !ttMove && !excludedMove && depth >= 4) depth--;
+    /**                                  **/
+
     MoveSelector ms;
     createMoveSelector(&ms, board, TT_MOVE, ttMove);
 
@@ -173,29 +344,49 @@ static Score alphaBeta(Score alpha, Score beta, Depth depth, Node node, SearchHe
     Score bestScore = -INFINITE, oldAlpha = alpha;
     Move  bestMove  =   NO_MOVE, move;
 
-    /* 6) Move Ordering */
+    /* 10) Move Ordering */
     while ((move = getNextBestMove(board, &ms))) {
-        if (!isLegalMove(board, move)) continue;
+        if (move == excludedMove || (node == ROOT && isExcludedRootMove(st, move))) continue;
         legalMoves++;
 
         bool expectedNonPvNode = !isPvNode || legalMoves > 1;
-        /** 7) Futility Pruning **/
-        if (expectedNonPvNode && depth < 4 && !checkers && !isInteresting(board, move) && getReverseFutilityPruningScore(staticEvaluation, depth) <= alpha) continue;
-        /**                     **/
+        bool isCheck = givesCheck(board, move);
+        /** 11) Futility Pruning **/
+        if (expectedNonPvNode && depth < 4 && !checkers && !isCheck && !isInteresting(board, move) && getReverseFutilityPruningScore(staticEvaluation, depth) <= alpha) continue;
+        /**                      **/
+
+        /** 12) Extensions **/
+        // Every extension is bounded so the ply never passes the size of the search stacks
+        int extension = 0;
+        if (node != ROOT && move == ttMove && !excludedMove && depth >= 8 && ttDepth + 3 >= depth && ttBound != UPPER 
+            && ttScore > -TABLEBASE_WIN && ttScore < TABLEBASE_WIN && st->ply + depth < MAX_DEPTH) {
+            // Singular extension: the TT move is extended when no other move comes close to its score
+            Score singularBeta = ttScore - 2 * depth;
+            sh->excludedMove = move;
+            Score score = alphaBeta(singularBeta - 1, singularBeta, (depth - 1) / 2, NON_PV, sh, st);
+            sh->excludedMove = NO_MOVE;
+            if (score < singularBeta) extension = 1;
+            else if (singularBeta >= beta) return singularBeta; // Multi-cut: another move fails high as well
+            else if (ttScore >= beta) extension = -1; // The TT move is not the only good move, so it is searched less
+        } else if (isCheck && st->ply + depth < MAX_DEPTH) {
+            extension = 1;
+        }
+        /**                **/
 
-        /** 8) Late Move Reductions **/
+        /** 13) Late Move Reductions **/
         int reductions = legalMoves > 1 && depth > 1 ? 2 : 1;
-        /**                         **/
+        /**                          **/
 
+        prefetchTranspositionTable(st->tt, getKeyAfter(board, move));
         st->ply++;
         *childAccumulator = *currentAccumulator;
-        makeMove(board, &history, childAccumulator, move);
+        makeMove(board, childAccumulator, move);
 
-        /* 9) Principal Variation Search */
+        /* 14) Principal Variation Search */
         Score score;
-        if (expectedNonPvNode) score = -alphaBeta(-alpha - 1, -alpha, depth - reductions, NON_PV, child, st);
-        if (isPvNode && (legalMoves == 1 || score > alpha)) score = -alphaBeta(-beta, -alpha, depth - 1, PV, child, st);
-        /*                               */
+        if (expectedNonPvNode) score = -alphaBeta(-alpha - 1, -alpha, depth - reductions + extension, NON_PV, child, st);
+        if (isPvNode && (legalMoves == 1 || score > alpha)) score = -alphaBeta(-beta, -alpha, depth - 1 + extension, PV, child, st);
+        /*                                */
         
         undoMove(board, move);
         st->ply--;
@@ -203,7 +394,10 @@ static Score alphaBeta(Score alpha, Score beta, Depth depth, Node node, SearchHe
         if (score > bestScore) {
             if (score > alpha) {
                 if (score >= beta) {
-                    if (!st->stop) savePositionEvaluation(st->tt, pe, positionKey, move, depth, LOWER, adjustNodeScoreToTT(score, st->ply), staticEvaluation);
+                    if (!st->stop && !excludedMove && !(node == ROOT && st->pvIndex)) {
+                        savePositionEvaluation(st->tt, pe, positionKey, move, depth, LOWER, adjustNodeScoreToTT(score, st->ply), rawEvaluation);
+                        if (!checkers && !isInteresting(board, move)) updateCorrectionHistory(st, score, staticEvaluation, LOWER, depth);
+                    }
                     return score;
                 }
                 updatePV(move, sh->pv, child->pv); // TODO: Only needs to be done once on the last score > alpha, but integrity is lost
@@ -213,13 +407,19 @@ static Score alphaBeta(Score alpha, Score beta, Depth depth, Node node, SearchHe
             bestMove = move;
         }
     }
-    /*                  */
+    /*                   */
 
-    /* 10) Checkmate and Stalemate Detection */
-    if (!legalMoves) bestScore = checkers ? -CHECKMATE + st->ply : DRAW; // TODO: Should this be considered EXACT bound?
+    /* 15) Checkmate and Stalemate Detection */
+    // Without the excluded move there may be no moves left, which only means the excluded move is singular
+    if (!legalMoves) bestScore = excludedMove ? alpha : checkers ? -CHECKMATE + st->ply : DRAW; // TODO: Should this be considered EXACT bound?
     /*                                       */
 
-    if (!st->stop) savePositionEvaluation(st->tt, pe, positionKey, bestMove, depth, bestScore > oldAlpha ? EXACT : UPPER, adjustNodeScoreToTT(bestScore == -INFINITE ? staticEvaluation : bestScore, st->ply), staticEvaluation);
+    // Secondary MultiPV lines and singular extension searches exclude moves, so their result is not stored
+    if (!st->stop && !excludedMove && !(node == ROOT && st->pvIndex)) {
+        Bound bound = bestScore > oldAlpha ? EXACT : UPPER;
+        savePositionEvaluation(st->tt, pe, positionKey, bestMove, depth, bound, adjustNodeScoreToTT(bestScore == -INFINITE ? staticEvaluation : bestScore, st->ply), rawEvaluation);
+        if (!checkers && legalMoves && !(bestMove && isInteresting(board, bestMove))) updateCorrectionHistory(st, bestScore, staticEvaluation, bound, depth);
+    }
     return bestScore;
 }
 
@@ -227,28 +427,56 @@ void* startSearch(void *searchThread) {
     constexpr Score ASPIRATION_WINDOW = 25;
     SearchThread *st = searchThread;
     SearchHelper sh[MAX_DEPTH + 1];
+    for (int i = 0; i <= MAX_DEPTH; i++) sh[i].excludedMove = NO_MOVE;
     
-    char pvString[2048], bestMove[6], ponderMove[6];
-    Score score, alpha = -INFINITE, beta = INFINITE;
-    st->nodes = 0;
+    char pvString[2048], bestMove[6] = "", ponderMove[6] = "";
+    st->bestMove = (MoveObject) {0};
+    st->stop = false;
+    st->nodes = st->tbHits = 0;
     st->startNs = getTimeNs();
-    for (Depth depth = 1; depth && !outOfTime(st); depth++) {
-        score = alphaBeta(alpha, beta, depth, ROOT, sh, st);
-        if (score > alpha && score < beta && !st->stop) {
-            alpha = score - ASPIRATION_WINDOW;
-            beta = score + ASPIRATION_WINDOW;
-            
-            st->bestMove.move  = sh[0].pv[0];
-            st->bestMove.score = score;
-
-            pvToString(pvString, bestMove, ponderMove, sh[0].pv);
-            if (st->print) printSearch(depth, score, pvString, st);
-        } else {
-            depth--;
-            alpha = score > alpha ? alpha : -INFINITE;
-            beta  = score < beta  ? beta  :  INFINITE;
+    st->rootMovesCount = 0;
+    if (!st->board.history->castlingRights && populationCount(getOccupiedSquares(&st->board)) <= largestTablebase)
+        st->rootMovesCount = filterRootMoves(&st->board, st->rootMoves);
+    st->multiPV = max(1, min(st->multiPV, st->rootMovesCount ? st->rootMovesCount : countLegalMoves(&st->board)));
+    for (int i = 0; i < st->multiPV; i++) st->pvLines[i] = (PVLine) {.alpha = -INFINITE, .beta = INFINITE};
+
+    for (Depth depth = 1; depth && depth <= st->maxDepth && !outOfTime(st); depth++) {
+        if (st->softNodes && st->nodes >= st->softNodes) break;
+        st->pvIndex = 0;
+        while (st->pvIndex < st->multiPV && !st->stop) {
+            PVLine *line = &st->pvLines[st->pvIndex];
+            Score score = alphaBeta(line->alpha, line->beta, depth, ROOT, sh, st);
+            if (score > line->alpha && score < line->beta && !st->stop) {
+                line->alpha = score - ASPIRATION_WINDOW;
+                line->beta  = score + ASPIRATION_WINDOW;
+
+                line->bestMove.move  = sh[0].pv[0];
+                line->bestMove.score = score;
+                for (int i = 0; i < MAX_DEPTH && (line->pv[i] = sh[0].pv[i]); i++);
+                st->pvIndex++;
+            } else {
+                line->alpha = score > line->alpha ? line->alpha : -INFINITE;
+                line->beta  = score < line->beta  ? line->beta  :  INFINITE;
+            }
+        }
+
+        // Only the lines completed at this depth are ranked, the best of them is played
+        int completedLines = st->pvIndex;
+        if (!completedLines) continue;
+        sortPVLines(st->pvLines, completedLines);
+        st->bestMove = st->pvLines[0].bestMove;
+        pvToString(pvString, bestMove, ponderMove, st->pvLines[0].pv);
+        for (int i = 0; st->print && i < completedLines; i++) {
+            char lineMove[6], linePonderMove[6];
+            pvToString(pvString, lineMove, linePonderMove, st->pvLines[i].pv);
+            printSearch(depth, i + 1, st->pvLines[i].bestMove.score, pvString, st);
         }
     }
+    // UCI forbids sending bestmove while pondering, even if the search has nothing left to do
+    struct timespec wait = {.tv_nsec = 1000000};
+    while (atomic_load_explicit(&st->ponder, memory_order_relaxed) && !atomic_load_explicit(&st->stopRequested, memory_order_relaxed))
+        nanosleep(&wait, nullptr);
+
     if (st->print) {
         if (ponderMove[0]) printf("bestmove %s ponder %s\n", bestMove, ponderMove);
         else printf("bestmove %s\n", bestMove);
@@ -256,13 +484,35 @@ void* startSearch(void *searchThread) {
     return &st->bestMove;
 }
 
-void startSearchThreads(UCI_Configuration *restrict config, uint64_t searchTimeNs) {
+static SearchThread searchThread;
+static pthread_t searchThreadId;
+static bool searching;
+
+void startSearchThreads(UCI_Configuration *restrict config, uint64_t searchTimeNs, bool ponder) {
+    stopSearchThreads();
     config->tt.age++;
 
-    pthread_t th;
-    SearchThread st;
-    createSearchThread(&st, &config->board, &config->tt, searchTimeNs, true);
-    accumulator[0] = config->accumulator;
-    pthread_create(&th, nullptr, startSearch, &st);
-    pthread_join(th, nullptr);
+    createSearchThread(&searchThread, &config->board, &config->tt, searchTimeNs, config->multiPV, true);
+    atomic_store_explicit(&searchThread.ponder, ponder, memory_order_relaxed);
+    pthread_create(&searchThreadId, nullptr, startSearch, &searchThread);
+    searching = true;
+}
+
+void stopSearchThreads() {
+    if (!searching) return;
+    atomic_store_explicit(&searchThread.stopRequested, true, memory_order_relaxed);
+    pthread_join(searchThreadId, nullptr);
+    searching = false;
+}
+
+void clearSearchThreads() {
+    stopSearchThreads();
+    memset(searchThread.pawnCorrection    , 0, sizeof(searchThread.pawnCorrection    ));
+    memset(searchThread.materialCorrection, 0, sizeof(searchThread.materialCorrection));
+}
+
+void ponderHitSearchThreads() {
+    if (!searching) return;
+    searchThread.maxSearchTimeNs += getTimeNs() - searchThread.startNs;
+    atomic_store_explicit(&searchThread.ponder, false, memory_order_release);
 }
@@ -1,23 +1,53 @@
 #ifndef SEARCH_H
 #define SEARCH_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <time.h>
 #include "chess_board.h"
 #include "transposition_table.h"
 #include "uci.h"
+#include "nnue.h"
 #include "utility.h"
 
+constexpr Depth MAX_DEPTH = 255;
+constexpr int MAX_MULTIPV = 64; // Every search thread holds this many full lines
+constexpr int CORRECTION_HISTORY_SIZE = 16384;
+
+typedef struct PrincipalVariationLine {
+    Score alpha;
+    Score beta;
+    MoveObject bestMove;
+    Move pv[MAX_DEPTH];
+} PVLine;
+
 typedef struct SearchThread {
     ChessBoard board;
+    ChessBoardHistory histories[MAX_HISTORY];
+    Accumulator accumulators[(MAX_DEPTH + 1) * 2]; // TODO: Sizing
+    // Accumulated error of the corrected static evaluation against the search score, kept across searches
+    int16_t pawnCorrection[COLOURS][CORRECTION_HISTORY_SIZE];
+    int16_t materialCorrection[COLOURS][CORRECTION_HISTORY_SIZE];
+    PVLine pvLines[MAX_MULTIPV]; // Lines before pvIndex are excluded from the root search
+    Move rootMoves[MAX_MOVES]; // Root moves kept by the tablebases, all legal moves are searched when empty
+    uint8_t rootMovesCount;
+    uint8_t multiPV;
+    uint8_t pvIndex;
     TT *tt;
     uint64_t startNs; // TODO: Could change implementation
     uint64_t maxSearchTimeNs;
+    uint64_t softNodes; // No new iteration is started past this, 0 for no limit
+    uint64_t hardNodes; // Aborts the search, 0 for no limit
+    Depth maxDepth;
     uint64_t nodes;
+    uint64_t tbHits;
     MoveObject bestMove;
     uint8_t ply;
     bool print;
+    bool ignoreTT; // Set while quiescenceEvaluation runs
     bool stop;
+    atomic_bool ponder; // While set the search ignores its time budget and holds its bestmove
+    atomic_bool stopRequested;
 } SearchThread;
 
 static inline uint64_t getTimeNs() {
@@ -26,20 +56,43 @@ static inline uint64_t getTimeNs() {
     return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
 }
 
-static inline void createSearchThread(SearchThread *st, const ChessBoard *restrict board, TT *tt, uint64_t maxSearchTimeNs, bool print) {
-    st->board = *board; // TODO: The history pointer is a shallow copy, consider using a deep copy
+static inline void createSearchThread(SearchThread *st, const ChessBoard *restrict board, TT *tt, uint64_t maxSearchTimeNs, uint8_t multiPV, bool print) {
+    copyChessBoard(&st->board, st->histories, board);
+    refreshAccumulator(&st->accumulators[0], board);
     st->tt = tt;
+    st->multiPV = multiPV;
     st->maxSearchTimeNs = maxSearchTimeNs;
+    st->softNodes = st->hardNodes = 0;
+    st->maxDepth = MAX_DEPTH;
+    st->startNs = getTimeNs();
     st->ply = 0;
     st->print = print;
+    st->ignoreTT = false;
     st->stop = false;
+    atomic_store_explicit(&st->ponder, false, memory_order_relaxed);
+    atomic_store_explicit(&st->stopRequested, false, memory_order_relaxed);
 }
 
+// The first iteration always completes so there is a move to play
 static inline bool outOfTime(SearchThread *st) {
+    if (!st->bestMove.move) return false;
+    if (atomic_load_explicit(&st->stopRequested, memory_order_relaxed)) return st->stop = true;
+    if (st->hardNodes && st->nodes >= st->hardNodes) return st->stop = true;
+    if (atomic_load_explicit(&st->ponder, memory_order_acquire)) return false;
     return st->stop = getTimeNs() - st->startNs >= st->maxSearchTimeNs;
 }
 
 void* startSearch(void *searchThread);
-void startSearchThreads(UCI_Configuration *restrict config, uint64_t searchTimeNs);
+// Quiescence score of the thread's root position, relative to the side to move
+Score quiescenceEvaluation(SearchThread *st);
+
+// The search runs in the background, any previous search is stopped first
+void startSearchThreads(UCI_Configuration *restrict config, uint64_t searchTimeNs, bool ponder);
+void stopSearchThreads();
+// Forgets what the search threads learned from earlier games
+void clearSearchThreads();
+
+// The search continues with searchTimeNs (from go ponder) counted from now
+void ponderHitSearchThreads();
 
 #endif
@@ -0,0 +1,980 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "syzygy.h"
+#include "chess_board.h"
+#include "move_generator.h"
+#include "utility.h"
+
+// A port of the Syzygy probing code, see: https://github.com/syzygy1/tb
+// Tablebase squares are numbered A1 == 0 to H8 == 63, and pieces are encoded as PieceType + 8 * Colour.
+
+constexpr int TB_PIECES       =       7;
+constexpr int TB_HASH_SIZE    = 1 << 12; // Must be a power of 2
+constexpr int MAX_TABLEBASES  =    2048;
+constexpr int MAX_DTZ         = 1 << 18;
+constexpr int MAX_PATH_LENGTH =    4096;
+
+#ifdef _WIN32
+constexpr char PATH_SEPARATOR = ';';
+#else
+constexpr char PATH_SEPARATOR = ':';
+#endif
+
+typedef uint16_t Symbol; // Huffman symbol
+
+typedef enum TablebaseType {
+    TB_WDL, TB_DTZ
+} TablebaseType;
+
+typedef enum TablebaseFlag {
+    TB_STM = 1, TB_MAPPED = 2, TB_WIN_PLIES = 4, TB_LOSS_PLIES = 8, TB_WIDE = 16, TB_SINGLE_VALUE = 128
+} TablebaseFlag;
+
+// Low level indexing information, populated when the file is first memory-mapped.
+// Multi-byte values inside the file are read through the readLE/readBE helpers since they are not aligned.
+typedef struct PairsData {
+    const uint8_t *lowestSymbol; // lowestSymbol[l] is the symbol of length l with the lowest value
+    const uint8_t *btree;        // 3 bytes per symbol: the left and right symbols that expand it
+    const uint8_t *blockLength;  // Number of stored positions (minus one) for each block
+    const uint8_t *sparseIndex;  // 6 bytes per entry: the block and the offset within it of every span values
+    const uint8_t *data;         // Start of the Huffman compressed data
+    uint64_t *base64;            // base64[l - minSymbolLength] is the 64 bit padded lowest symbol of length l
+    uint8_t *symbolLength;       // Number of values (minus one) represented by a symbol
+    size_t blockSize;
+    size_t span;
+    size_t sparseIndexSize;
+    uint64_t groupIdx[TB_PIECES + 1]; // Start index used for the encoding of the group's pieces
+    int groupLength[TB_PIECES + 1];   // Number of pieces in a given group, zero terminated
+    uint32_t numberOfBlocks;
+    uint32_t blockLengthSize;
+    uint16_t symbols;
+    uint16_t mapIdx[4]; // WDL_WIN, WDL_LOSS, WDL_CURSED_WIN, WDL_BLESSED_LOSS (DTZ only)
+    uint8_t pieces[TB_PIECES];
+    uint8_t flags;
+    uint8_t maxSymbolLength;
+    uint8_t minSymbolLength;
+} PairsData;
+
+typedef struct TablebaseTable {
+    PairsData items[COLOURS][FILE_D + 1]; // [Side to move][Leading pawn file, FILE_A if there are no pawns]
+    void *baseAddress;
+    uint64_t mapping;
+    const uint8_t *map; // DTZ value remapping
+    Key key;            // Material key with white as the stronger side
+    Key key2;           // Material key with the colours swapped
+    TablebaseType type;
+    atomic_bool ready;
+    int pieceCount;
+    bool hasPawns;
+    bool hasUniquePieces;
+    uint8_t pawnCount[COLOURS]; // [Leading colour, other colour]
+} TablebaseTable;
+
+typedef struct TablebaseEntry {
+    Key key;
+    TablebaseTable *wdl;
+    TablebaseTable *dtz;
+} TablebaseEntry;
+
+int largestTablebase;
+
+static TablebaseEntry hashTable[TB_HASH_SIZE];
+static TablebaseTable *wdlTables, *dtzTables;
+static int tablebaseCount;
+static char tablebasePaths[MAX_PATH_LENGTH];
+static pthread_mutex_t mappingLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int mapPawns[SQUARES];
+static int mapB1H1H7[SQUARES];
+static int mapA1D1D4[SQUARES];
+static int mapKK[10][SQUARES];
+static int binomial[6][SQUARES];     // [k][n] k elements from a set of n elements
+static int leadPawnIdx[6][SQUARES];  // [Leading pawns][Square]
+static int leadPawnsSize[6][FILE_D + 1]; // [Leading pawns][FILE_A..FILE_D]
+
+static inline uint16_t readLE16(const uint8_t *p) {
+    return p[0] | p[1] << 8;
+}
+
+static inline uint32_t readLE32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static inline uint32_t readBE32(const uint8_t *p) {
+    return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline uint64_t readBE64(const uint8_t *p) {
+    return (uint64_t) readBE32(p) << 32 | readBE32(p + 4);
+}
+
+static inline Symbol getLeftSymbol(const uint8_t *btree, Symbol sym) {
+    return (btree[3 * sym + 1] & 0xF) << 8 | btree[3 * sym];
+}
+
+static inline Symbol getRightSymbol(const uint8_t *btree, Symbol sym) {
+    return btree[3 * sym + 2] << 4 | btree[3 * sym + 1] >> 4;
+}
+
+static inline int toTablebaseSquare(Square sq) {
+    return sq ^ 56;
+}
+
+static inline int tablebaseRank(int sq) {
+    return sq >> 3;
+}
+
+static inline int tablebaseFile(int sq) {
+    return sq & 7;
+}
+
+static inline int offA1H8(int sq) {
+    return tablebaseRank(sq) - tablebaseFile(sq);
+}
+
+static inline int signOf(int value) {
+    return (0 < value) - (value < 0);
+}
+
+static inline bool isCapture(const ChessBoard *restrict board, Move move) {
+    return getPiece(board, getToSquare(move)) || getMoveType(move) == EN_PASSANT;
+}
+
+static inline PairsData* getPairsData(TablebaseTable *table, int stm, int file) {
+    return &table->items[table->type == TB_WDL ? stm : 0][table->hasPawns ? file : 0];
+}
+
+// Packs the number of each non-king piece into 4 bits, so the key is exact
+static Key materialKeyFromCounts(const int counts[COLOURS][PIECE_TYPES]) {
+    Key key = 0;
+    for (Colour c = WHITE; c < COLOURS; c++)
+        for (PieceType pt = PAWN; pt < KING; pt++)
+            key |= (Key) counts[c][pt] << 4 * (c * (KING - PAWN) + pt - PAWN);
+    return key;
+}
+
+static Key getTablebaseMaterialKey(const ChessBoard *restrict board) {
+    int counts[COLOURS][PIECE_TYPES];
+    for (Colour c = WHITE; c < COLOURS; c++)
+        for (PieceType pt = PAWN; pt < KING; pt++)
+            counts[c][pt] = populationCount(getPieces(board, c, pt));
+    return materialKeyFromCounts(counts);
+}
+
+static inline uint32_t hashIndex(Key key) {
+    return key * 0x9E3779B97F4A7C15ULL >> 52;
+}
+
+static TablebaseTable* getTablebase(Key key, TablebaseType type) {
+    for (uint32_t i = hashIndex(key); hashTable[i].wdl; i = (i + 1) & (TB_HASH_SIZE - 1))
+        if (hashTable[i].key == key) return type == TB_WDL ? hashTable[i].wdl : hashTable[i].dtz;
+    return nullptr;
+}
+
+static void insertTablebase(Key key, TablebaseTable *wdl, TablebaseTable *dtz) {
+    uint32_t i = hashIndex(key);
+    while (hashTable[i].wdl && hashTable[i].key != key) i = (i + 1) & (TB_HASH_SIZE - 1);
+    hashTable[i] = (TablebaseEntry) {key, wdl, dtz};
+}
+
+// Writes the path of the first directory containing the file, returns false if it was not found
+static bool findTablebaseFile(const char *restrict filename, char *restrict fullPath) {
+    const char *directory = tablebasePaths;
+    while (*directory) {
+        const char *end = strchr(directory, PATH_SEPARATOR);
+        int length = end ? end - directory : (int) strlen(directory);
+        snprintf(fullPath, MAX_PATH_LENGTH, "%.*s/%s", length, directory, filename);
+        FILE *file = fopen(fullPath, "rb");
+        if (file) {
+            fclose(file);
+            return true;
+        }
+        if (!end) break;
+        directory = end + 1;
+    }
+    return false;
+}
+
+static void unmapTablebaseFile(TablebaseTable *table) {
+#ifdef _WIN32
+    UnmapViewOfFile(table->baseAddress);
+    CloseHandle((HANDLE) table->mapping);
+#else
+    munmap(table->baseAddress, table->mapping);
+#endif
+    table->baseAddress = nullptr;
+}
+
+// Returns the data after the magic header, or nullptr if the file is missing or corrupted
+static const uint8_t* mapTablebaseFile(TablebaseTable *table, const char *restrict filename) {
+    static const uint8_t MAGIC[][4] = {[TB_WDL] = {0x71, 0xE8, 0x23, 0x5D}, [TB_DTZ] = {0xD7, 0x66, 0x0C, 0xA5}};
+    char fullPath[MAX_PATH_LENGTH];
+    if (!findTablebaseFile(filename, fullPath)) return nullptr;
+
+    uint64_t size;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fullPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    DWORD sizeHigh;
+    DWORD sizeLow = GetFileSize(file, &sizeHigh);
+    size = (uint64_t) sizeHigh << 32 | sizeLow;
+    HANDLE mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, sizeHigh, sizeLow, nullptr);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+    table->mapping = (uint64_t) mapping;
+    table->baseAddress = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!table->baseAddress) {
+        CloseHandle(mapping);
+        return nullptr;
+    }
+#else
+    int fd = open(fullPath, O_RDONLY);
+    if (fd == -1) return nullptr;
+    struct stat fileStatus;
+    fstat(fd, &fileStatus);
+    size = table->mapping = fileStatus.st_size;
+    table->baseAddress = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (table->baseAddress == MAP_FAILED) {
+        table->baseAddress = nullptr;
+        return nullptr;
+    }
+    madvise(table->baseAddress, size, MADV_RANDOM);
+#endif
+
+    const uint8_t *data = table->baseAddress;
+    if (size % 64 != 16 || memcmp(data, MAGIC[table->type], 4)) {
+        printf("info string corrupted tablebase file %s\n", fullPath);
+        unmapTablebaseFile(table);
+        return nullptr;
+    }
+    return data + 4;
+}
+
+// Groups the pieces that are encoded together: pieces of the same type and colour, except for the leading group
+// which holds the leading pawns, or without pawns either 3 unique pieces or the king pair. Examples: KRvKN -> KRK + N, KNNvK -> KK + NN
+static void setGroups(const TablebaseTable *table, PairsData *d, const int order[2], int file) {
+    int n = 0, firstLength = table->hasPawns ? 0 : table->hasUniquePieces ? 3 : 2;
+    d->groupLength[n] = 1;
+    for (int i = 1; i < table->pieceCount; i++)
+        if (--firstLength > 0 || d->pieces[i] == d->pieces[i - 1]) d->groupLength[n]++;
+        else d->groupLength[++n] = 1;
+    d->groupLength[++n] = 0;
+
+    // The order of the groups in the encoding is a per table parameter: the leading group is at order[0] and the
+    // remaining pawns, if present, at order[1]
+    bool pawnsOnBothSides = table->hasPawns && table->pawnCount[1];
+    int next = pawnsOnBothSides ? 2 : 1;
+    int freeSquares = SQUARES - d->groupLength[0] - (pawnsOnBothSides ? d->groupLength[1] : 0);
+    uint64_t idx = 1;
+    for (int k = 0; next < n || k == order[0] || k == order[1]; k++) {
+        if (k == order[0]) {
+            d->groupIdx[0] = idx;
+            idx *= table->hasPawns ? leadPawnsSize[d->groupLength[0]][file] : table->hasUniquePieces ? 31332 : 462;
+        } else if (k == order[1]) {
+            d->groupIdx[1] = idx;
+            idx *= binomial[d->groupLength[1]][48 - d->groupLength[0]];
+        } else {
+            d->groupIdx[next] = idx;
+            idx *= binomial[d->groupLength[next]][freeSquares];
+            freeSquares -= d->groupLength[next++];
+        }
+    }
+    d->groupIdx[n] = idx;
+}
+
+// With Recursive Pairing each symbol represents a pair of child symbols
+static uint8_t setSymbolLength(PairsData *d, Symbol sym, bool *visited) {
+    visited[sym] = true;
+    Symbol right = getRightSymbol(d->btree, sym);
+    if (right == 0xFFF) return 0;
+
+    Symbol left = getLeftSymbol(d->btree, sym);
+    if (!visited[left])  d->symbolLength[left]  = setSymbolLength(d, left , visited);
+    if (!visited[right]) d->symbolLength[right] = setSymbolLength(d, right, visited);
+    return d->symbolLength[left] + d->symbolLength[right] + 1;
+}
+
+static const uint8_t* setSizes(PairsData *d, const uint8_t *data) {
+    d->flags = *data++;
+    if (d->flags & TB_SINGLE_VALUE) {
+        d->numberOfBlocks = d->blockLengthSize = 0;
+        d->span = d->sparseIndexSize = 0;
+        d->minSymbolLength = *data++; // The single value
+        return data;
+    }
+
+    int groups = 0;
+    while (d->groupLength[groups]) groups++;
+    uint64_t tablebaseSize = d->groupIdx[groups];
+
+    d->blockSize = 1ULL << *data++;
+    d->span = 1ULL << *data++;
+    d->sparseIndexSize = (tablebaseSize + d->span - 1) / d->span;
+    uint8_t padding = *data++;
+    d->numberOfBlocks = readLE32(data);
+    data += sizeof(uint32_t);
+    d->blockLengthSize = d->numberOfBlocks + padding; // Padded so the sparse index does not point out of range
+    d->maxSymbolLength = *data++;
+    d->minSymbolLength = *data++;
+    d->lowestSymbol = data;
+
+    // Canonical Huffman code: longer symbols have lower numeric values, so base64[i] >= base64[i + 1]
+    int base64Size = d->maxSymbolLength - d->minSymbolLength + 1;
+    d->base64 = calloc(base64Size, sizeof(uint64_t));
+    for (int i = base64Size - 2; i >= 0; i--)
+        d->base64[i] = (d->base64[i + 1] + readLE16(&d->lowestSymbol[2 * i]) - readLE16(&d->lowestSymbol[2 * (i + 1)])) / 2;
+    for (int i = 0; i < base64Size; i++) d->base64[i] <<= 64 - i - d->minSymbolLength;
+
+    data += base64Size * sizeof(Symbol);
+    d->symbols = readLE16(data);
+    data += sizeof(uint16_t);
+    d->btree = data;
+
+    d->symbolLength = calloc(d->symbols, sizeof(uint8_t));
+    bool *visited = calloc(d->symbols, sizeof(bool));
+    for (int sym = 0; sym < d->symbols; sym++)
+        if (!visited[sym]) d->symbolLength[sym] = setSymbolLength(d, sym, visited);
+    free(visited);
+
+    return data + d->symbols * 3 + (d->symbols & 1);
+}
+
+static const uint8_t* setDTZMap(TablebaseTable *table, const uint8_t *data, int maxFile) {
+    table->map = data;
+    for (int file = FILE_A; file <= maxFile; file++) {
+        PairsData *d = getPairsData(table, 0, file);
+        if (!(d->flags & TB_MAPPED)) continue;
+        if (d->flags & TB_WIDE) {
+            data += (uintptr_t) data & 1; // Word alignment
+            for (int i = 0; i < 4; i++) {
+                d->mapIdx[i] = (data - table->map) / 2 + 1;
+                data += 2 * readLE16(data) + 2;
+            }
+        } else {
+            for (int i = 0; i < 4; i++) {
+                d->mapIdx[i] = data - table->map + 1;
+                data += *data + 1;
+            }
+        }
+    }
+    return data + ((uintptr_t) data & 1);
+}
+
+// Populates the pairs data from the just memory-mapped file
+static void initializeTablebaseTable(TablebaseTable *table, const uint8_t *data) {
+    data++; // Flags
+    int sides = table->type == TB_WDL && table->key != table->key2 ? 2 : 1;
+    int maxFile = table->hasPawns ? FILE_D : FILE_A;
+    bool pawnsOnBothSides = table->hasPawns && table->pawnCount[1];
+
+    for (int file = FILE_A; file <= maxFile; file++) {
+        for (int i = 0; i < sides; i++) *getPairsData(table, i, file) = (PairsData) {0};
+
+        int order[COLOURS][2] = {{*data & 0xF, pawnsOnBothSides ? data[1] & 0xF : 0xF},
+                                 {*data >>  4, pawnsOnBothSides ? data[1] >>  4 : 0xF}};
+        data += 1 + pawnsOnBothSides;
+
+        for (int k = 0; k < table->pieceCount; k++, data++)
+            for (int i = 0; i < sides; i++)
+                getPairsData(table, i, file)->pieces[k] = i ? *data >> 4 : *data & 0xF;
+
+        for (int i = 0; i < sides; i++) setGroups(table, getPairsData(table, i, file), order[i], file);
+    }
+    data += (uintptr_t) data & 1;
+
+    for (int file = FILE_A; file <= maxFile; file++)
+        for (int i = 0; i < sides; i++) data = setSizes(getPairsData(table, i, file), data);
+
+    if (table->type == TB_DTZ) data = setDTZMap(table, data, maxFile);
+
+    for (int file = FILE_A; file <= maxFile; file++)
+        for (int i = 0; i < sides; i++) {
+            PairsData *d = getPairsData(table, i, file);
+            d->sparseIndex = data;
+            data += d->sparseIndexSize * 6;
+        }
+
+    for (int file = FILE_A; file <= maxFile; file++)
+        for (int i = 0; i < sides; i++) {
+            PairsData *d = getPairsData(table, i, file);
+            d->blockLength = data;
+            data += d->blockLengthSize * sizeof(uint16_t);
+        }
+
+    for (int file = FILE_A; file <= maxFile; file++)
+        for (int i = 0; i < sides; i++) {
+            PairsData *d = getPairsData(table, i, file);
+            data = (const uint8_t *) (((uintptr_t) data + 0x3F) & ~(uintptr_t) 0x3F); // 64 byte alignment
+            d->data = data;
+            data += (uint64_t) d->numberOfBlocks * d->blockSize;
+        }
+}
+
+// Memory-maps the file on the first access, thread safe
+static bool mapTablebase(TablebaseTable *table, const ChessBoard *restrict board) {
+    if (atomic_load_explicit(&table->ready, memory_order_acquire)) return table->baseAddress;
+
+    pthread_mutex_lock(&mappingLock);
+    if (!atomic_load_explicit(&table->ready, memory_order_relaxed)) {
+        constexpr char PIECE_TYPE_TO_CHAR[] = " PNBRQK";
+        char pieces[COLOURS][TB_PIECES + 1], filename[32];
+        for (Colour c = WHITE; c < COLOURS; c++) {
+            int length = 0;
+            for (PieceType pt = KING; pt >= PAWN; pt--)
+                for (int count = populationCount(getPieces(board, c, pt)); count; count--)
+                    pieces[c][length++] = PIECE_TYPE_TO_CHAR[pt];
+            pieces[c][length] = '\0';
+        }
+        Colour strong = getTablebaseMaterialKey(board) == table->key ? WHITE : BLACK;
+        snprintf(filename, sizeof(filename), "%sv%s%s", pieces[strong], pieces[strong ^ 1], table->type == TB_WDL ? ".rtbw" : ".rtbz");
+
+        const uint8_t *data = mapTablebaseFile(table, filename);
+        if (data) initializeTablebaseTable(table, data);
+        atomic_store_explicit(&table->ready, true, memory_order_release);
+    }
+    pthread_mutex_unlock(&mappingLock);
+    return table->baseAddress;
+}
+
+// The tables are compressed with a canonical Huffman code over blocks of symbols, each symbol representing
+// either a value or a pair of other symbols (Recursive Pairing). Returns the value stored at idx.
+static int decompressPairs(const PairsData *d, uint64_t idx) {
+    if (d->flags & TB_SINGLE_VALUE) return d->minSymbolLength;
+
+    // The sparse index stores the block and offset of every I(k) == k * span + span / 2 value
+    uint32_t k = idx / d->span;
+    uint32_t block = readLE32(&d->sparseIndex[6 * k]);
+    int offset = readLE16(&d->sparseIndex[6 * k + 4]);
+    offset += (int) (idx % d->span) - (int) (d->span / 2);
+
+    // Each block n stores blockLength[n] + 1 values
+    while (offset < 0) offset += readLE16(&d->blockLength[2 * --block]) + 1;
+    while (offset > readLE16(&d->blockLength[2 * block])) offset -= readLE16(&d->blockLength[2 * block++]) + 1;
+
+    const uint8_t *ptr = d->data + (uint64_t) block * d->blockSize;
+    uint64_t buf64 = readBE64(ptr);
+    int buf64Size = 64;
+    ptr += sizeof(uint64_t);
+
+    Symbol sym;
+    while (true) {
+        int length = 0; // Symbol length - minSymbolLength
+        while (buf64 < d->base64[length]) length++;
+
+        // Symbols of the same length are consecutive integers
+        sym = (buf64 - d->base64[length]) >> (64 - length - d->minSymbolLength);
+        sym += readLE16(&d->lowestSymbol[2 * length]);
+        if (offset < d->symbolLength[sym] + 1) break;
+
+        offset -= d->symbolLength[sym] + 1;
+        length += d->minSymbolLength;
+        buf64 <<= length;
+        buf64Size -= length;
+        if (buf64Size <= 32) {
+            buf64Size += 32;
+            buf64 |= (uint64_t) readBE32(ptr) << (64 - buf64Size);
+            ptr += sizeof(uint32_t);
+        }
+    }
+
+    // Expand the symbol through its children until reaching the leaf storing the value
+    while (d->symbolLength[sym]) {
+        Symbol left = getLeftSymbol(d->btree, sym);
+        if (offset < d->symbolLength[left] + 1) {
+            sym = left;
+        } else {
+            offset -= d->symbolLength[left] + 1;
+            sym = getRightSymbol(d->btree, sym);
+        }
+    }
+    return getLeftSymbol(d->btree, sym);
+}
+
+// DTZ values are sorted by frequency and remapped per WDL score, and may be stored in moves rather than plies
+static int mapScore(TablebaseTable *table, int file, int value, WDLScore wdl) {
+    if (table->type == TB_WDL) return value - 2;
+
+    constexpr int WDL_MAP[] = {1, 3, 0, 2, 0};
+    const PairsData *d = getPairsData(table, 0, file);
+    if (d->flags & TB_MAPPED) {
+        int index = d->mapIdx[WDL_MAP[wdl + 2]] + value;
+        value = d->flags & TB_WIDE ? readLE16(&table->map[2 * index]) : table->map[index];
+    }
+
+    if ((wdl == WDL_WIN  && !(d->flags & TB_WIN_PLIES))
+     || (wdl == WDL_LOSS && !(d->flags & TB_LOSS_PLIES))
+     ||  wdl == WDL_CURSED_WIN || wdl == WDL_BLESSED_LOSS)
+        value *= 2;
+    return value + 1;
+}
+
+static inline void swapSquares(int *restrict squares, int *restrict pieces, int i, int j) {
+    int temp = squares[i];
+    squares[i] = squares[j];
+    squares[j] = temp;
+    if (pieces) {
+        temp = pieces[i];
+        pieces[i] = pieces[j];
+        pieces[j] = temp;
+    }
+}
+
+// Encodes the position into a unique index. k pieces of the same type and colour sorted by square
+// s1 < s2 < ... < sk are encoded as binomial[1][s1] + binomial[2][s2] + ... + binomial[k][sk]
+static int probeTable(const ChessBoard *restrict board, TablebaseTable *table, WDLScore wdl, ProbeState *restrict result) {
+    int squares[TB_PIECES], pieces[TB_PIECES];
+    int size = 0, leadPawns = 0, file = FILE_A;
+    Bitboard leadPawnsBB = 0;
+    uint64_t idx;
+
+    // Tables are stored with white as the stronger side, and symmetric tables only store white to move
+    bool symmetricBlackToMove = table->key == table->key2 && board->sideToMove;
+    bool blackStronger = getTablebaseMaterialKey(board) != table->key;
+    bool flip = symmetricBlackToMove || blackStronger;
+    int flipColour = flip * 8, flipSquares = flip * 56;
+    int stm = flip ^ board->sideToMove;
+
+    // Tables with pawns are split by the file of the leading pawn, the one closest to the edge with the lowest rank
+    if (table->hasPawns) {
+        int pawn = getPairsData(table, 0, 0)->pieces[0] ^ flipColour;
+        Bitboard b = leadPawnsBB = getPieces(board, pawn >> 3, PAWN);
+        while (b) squares[size++] = toTablebaseSquare(bitboardToSquareWithReset(&b)) ^ flipSquares;
+        leadPawns = size;
+
+        int leading = 0;
+        for (int i = 1; i < leadPawns; i++)
+            if (mapPawns[squares[i]] > mapPawns[squares[leading]]) leading = i;
+        swapSquares(squares, nullptr, 0, leading);
+        file = min(tablebaseFile(squares[0]), FILE_H - tablebaseFile(squares[0]));
+    }
+
+    // DTZ tables only store one side to move
+    if (table->type == TB_DTZ && (getPairsData(table, stm, file)->flags & TB_STM) != stm && !(table->key == table->key2 && !table->hasPawns)) {
+        *result = PROBE_CHANGE_STM;
+        return 0;
+    }
+
+    Bitboard b = getOccupiedSquares(board) ^ leadPawnsBB;
+    while (b) {
+        Square sq = bitboardToSquareWithReset(&b);
+        squares[size] = toTablebaseSquare(sq) ^ flipSquares;
+        pieces[size++] = getPiece(board, sq) ^ flipColour; // Same encoding as the tables, piece type + 8 * colour
+    }
+
+    // Reorder the pieces to the sequence stored in the table
+    PairsData *d = getPairsData(table, stm, file);
+    for (int i = leadPawns; i < size - 1; i++)
+        for (int j = i + 1; j < size; j++)
+            if (d->pieces[i] == pieces[j]) {
+                swapSquares(squares, pieces, i, j);
+                break;
+            }
+
+    // The leading piece is mapped to the A1-D1-D4 triangle
+    if (tablebaseFile(squares[0]) > FILE_D)
+        for (int i = 0; i < size; i++) squares[i] ^= 7;
+
+    if (table->hasPawns) {
+        idx = leadPawnIdx[leadPawns][squares[0]];
+        for (int i = 2; i < leadPawns; i++)
+            for (int j = i; j > 1 && mapPawns[squares[j - 1]] > mapPawns[squares[j]]; j--) swapSquares(squares, nullptr, j - 1, j);
+        for (int i = 1; i < leadPawns; i++) idx += binomial[i][mapPawns[squares[i]]];
+    } else {
+        if (tablebaseRank(squares[0]) > RANK_4)
+            for (int i = 0; i < size; i++) squares[i] ^= 56;
+
+        // The first piece of the leading group not on the A1-H8 diagonal is mapped below it
+        for (int i = 0; i < d->groupLength[0]; i++) {
+            if (!offA1H8(squares[i])) continue;
+            if (offA1H8(squares[i]) > 0)
+                for (int j = i; j < size; j++) squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+            break;
+        }
+
+        if (table->hasUniquePieces) {
+            int adjust1 =  squares[1] > squares[0];
+            int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+
+            if (offA1H8(squares[0]))
+                idx = (mapA1D1D4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+            else if (offA1H8(squares[1]))
+                idx = (6 * 63 + tablebaseRank(squares[0]) * 28 + mapB1H1H7[squares[1]]) * 62 + squares[2] - adjust2;
+            else if (offA1H8(squares[2]))
+                idx = 6 * 63 * 62 + 4 * 28 * 62
+                    +  tablebaseRank(squares[0])            * 7 * 28
+                    + (tablebaseRank(squares[1]) - adjust1) * 28
+                    +  mapB1H1H7[squares[2]];
+            else
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28
+                    +  tablebaseRank(squares[0])            * 7 * 6
+                    + (tablebaseRank(squares[1]) - adjust1) * 6
+                    + (tablebaseRank(squares[2]) - adjust2);
+        } else {
+            idx = mapKK[mapA1D1D4[squares[0]]][squares[1]];
+        }
+    }
+
+    // Encode the remaining groups, mapping a square down for every square of the previous groups below it
+    idx *= d->groupIdx[0];
+    int *groupSquares = squares + d->groupLength[0];
+    bool remainingPawns = table->hasPawns && table->pawnCount[1];
+    for (int next = 1; d->groupLength[next]; next++) {
+        for (int i = 1; i < d->groupLength[next]; i++)
+            for (int j = i; j > 0 && groupSquares[j - 1] > groupSquares[j]; j--) swapSquares(groupSquares, nullptr, j - 1, j);
+
+        uint64_t n = 0;
+        for (int i = 0; i < d->groupLength[next]; i++) {
+            int adjust = 0;
+            for (const int *sq = squares; sq < groupSquares; sq++) adjust += groupSquares[i] > *sq;
+            n += binomial[i + 1][groupSquares[i] - adjust - 8 * remainingPawns];
+        }
+        remainingPawns = false;
+        idx += n * d->groupIdx[next];
+        groupSquares += d->groupLength[next];
+    }
+
+    return mapScore(table, file, decompressPairs(d, idx), wdl);
+}
+
+static int probeTablebase(const ChessBoard *restrict board, TablebaseType type, WDLScore wdl, ProbeState *restrict result) {
+    if (populationCount(getOccupiedSquares(board)) == 2) return WDL_DRAW; // KvK
+
+    TablebaseTable *table = getTablebase(getTablebaseMaterialKey(board), type);
+    if (!table || !mapTablebase(table, board)) {
+        *result = PROBE_FAIL;
+        return 0;
+    }
+    return probeTable(board, table, wdl, result);
+}
+
+// Winning captures are stored as "don't care" values, and drawing captures may hide a stored loss, so the
+// captures (and with DTZ the pawn moves) must be searched. The best of those and the stored value is the result.
+static WDLScore searchZeroingMoves(ChessBoard *restrict board, ProbeState *restrict result, bool checkPawnMoves) {
+    WDLScore value, bestValue = WDL_LOSS;
+    MoveObject moveList[MAX_MOVES];
+    MoveObject *endList = createMoveList(board, moveList, LEGAL);
+    int totalMoves = endList - moveList, zeroingMoves = 0;
+
+    for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) {
+        Move move = moveObj->move;
+        if (!isCapture(board, move) && (!checkPawnMoves || getPieceType(board, getFromSquare(move)) != PAWN)) continue;
+        zeroingMoves++;
+
+        makeMove(board, nullptr, move);
+        value = -searchZeroingMoves(board, result, false);
+        undoMove(board, move);
+
+        if (*result == PROBE_FAIL) return WDL_DRAW;
+        if (value > bestValue) {
+            bestValue = value;
+            if (value >= WDL_WIN) {
+                *result = PROBE_ZEROING_BEST_MOVE;
+                return value;
+            }
+        }
+    }
+
+    // When every legal move was searched the stored value could be wrong, for instance with en passant rights
+    bool noMoreMoves = zeroingMoves && zeroingMoves == totalMoves;
+    if (noMoreMoves) {
+        value = bestValue;
+    } else {
+        value = probeTablebase(board, TB_WDL, WDL_DRAW, result);
+        if (*result == PROBE_FAIL) return WDL_DRAW;
+    }
+
+    if (bestValue >= value) {
+        *result = bestValue > WDL_DRAW || noMoreMoves ? PROBE_ZEROING_BEST_MOVE : PROBE_OK;
+        return bestValue;
+    }
+    *result = PROBE_OK;
+    return value;
+}
+
+// DTZ tables do not store the value of zeroing moves, but it can be recovered from the WDL score
+static inline int dtzBeforeZeroing(WDLScore wdl) {
+    return wdl == WDL_WIN          ?    1
+         : wdl == WDL_CURSED_WIN   ?  101
+         : wdl == WDL_BLESSED_LOSS ? -101
+         : wdl == WDL_LOSS         ?   -1
+         : 0;
+}
+
+static void releaseTablebase(TablebaseTable *table) {
+    if (table->baseAddress) unmapTablebaseFile(table);
+    for (Colour c = WHITE; c < COLOURS; c++)
+        for (int file = FILE_A; file <= FILE_D; file++) {
+            free(table->items[c][file].base64);
+            free(table->items[c][file].symbolLength);
+        }
+}
+
+// Pieces are listed from white's king, example: {KING, ROOK, KING} -> KRvK
+static void addTablebase(const PieceType *pieces, int count) {
+    constexpr char PIECE_TYPE_TO_CHAR[] = " PNBRQK";
+    char filename[32];
+    int counts[COLOURS][PIECE_TYPES] = {0}, length = 0;
+    Colour c = BLACK;
+    for (int i = 0; i < count; i++) {
+        if (pieces[i] == KING) {
+            c ^= 1;
+            if (i) filename[length++] = 'v';
+        }
+        filename[length++] = PIECE_TYPE_TO_CHAR[pieces[i]];
+        counts[c][pieces[i]]++;
+    }
+    strcpy(&filename[length], ".rtbw");
+
+    char fullPath[MAX_PATH_LENGTH];
+    if (tablebaseCount == MAX_TABLEBASES || !findTablebaseFile(filename, fullPath)) return;
+
+    TablebaseTable *wdl = &wdlTables[tablebaseCount];
+    TablebaseTable *dtz = &dtzTables[tablebaseCount++];
+    wdl->type = TB_WDL;
+    wdl->key = materialKeyFromCounts(counts);
+    wdl->pieceCount = count;
+    wdl->hasPawns = counts[WHITE][PAWN] || counts[BLACK][PAWN];
+    for (c = WHITE; c < COLOURS; c++)
+        for (PieceType pt = PAWN; pt < KING; pt++)
+            wdl->hasUniquePieces |= counts[c][pt] == 1;
+
+    // The leading colour is the side with less pawns, as this leads to better compression
+    Colour leading = !counts[BLACK][PAWN] || (counts[WHITE][PAWN] && counts[BLACK][PAWN] >= counts[WHITE][PAWN]) ? WHITE : BLACK;
+    wdl->pawnCount[0] = counts[leading    ][PAWN];
+    wdl->pawnCount[1] = counts[leading ^ 1][PAWN];
+
+    int swapped[COLOURS][PIECE_TYPES];
+    memcpy(swapped[WHITE], counts[BLACK], sizeof(counts[BLACK]));
+    memcpy(swapped[BLACK], counts[WHITE], sizeof(counts[WHITE]));
+    wdl->key2 = materialKeyFromCounts(swapped);
+
+    *dtz = *wdl;
+    dtz->type = TB_DTZ;
+    largestTablebase = max(largestTablebase, count);
+    insertTablebase(wdl->key , wdl, dtz);
+    insertTablebase(wdl->key2, wdl, dtz);
+}
+
+void initializeSyzygy(const char *restrict paths) {
+    static bool initializedIndices = false;
+    if (!initializedIndices) {
+        initializedIndices = true;
+
+        // mapB1H1H7 encodes a square below the A1-H8 diagonal to 0..27
+        int code = 0;
+        for (int sq = 0; sq < SQUARES; sq++)
+            if (offA1H8(sq) < 0) mapB1H1H7[sq] = code++;
+
+        // mapA1D1D4 encodes a square in the A1-D1-D4 triangle to 0..9, the diagonal squares last
+        int diagonal[4], diagonalSquares = 0;
+        code = 0;
+        for (int rank = 0; rank < 4; rank++)
+            for (int file = 0; file < 4; file++) {
+                int sq = rank * 8 + file;
+                if (offA1H8(sq) < 0) mapA1D1D4[sq] = code++;
+                else if (!offA1H8(sq)) diagonal[diagonalSquares++] = sq;
+            }
+        for (int i = 0; i < diagonalSquares; i++) mapA1D1D4[diagonal[i]] = code++;
+
+        // mapKK encodes the 462 legal placements of two kings with the first in the A1-D1-D4 triangle. If the first
+        // king is on the diagonal the second is not above it, and placements with both on the diagonal are last.
+        int bothOnDiagonal[64][2], bothOnDiagonalCount = 0;
+        code = 0;
+        for (int idx = 0; idx < 10; idx++)
+            for (int sq1 = 0; sq1 <= 27; sq1++) {
+                if (mapA1D1D4[sq1] != idx || (!idx && sq1 != 1)) continue; // B1 is mapped to 0
+                for (int sq2 = 0; sq2 < SQUARES; sq2++) {
+                    if (abs(tablebaseRank(sq1) - tablebaseRank(sq2)) <= 1 && abs(tablebaseFile(sq1) - tablebaseFile(sq2)) <= 1) continue;
+                    if (!offA1H8(sq1) && offA1H8(sq2) > 0) continue;
+                    if (!offA1H8(sq1) && !offA1H8(sq2)) {
+                        bothOnDiagonal[bothOnDiagonalCount][0] = idx;
+                        bothOnDiagonal[bothOnDiagonalCount++][1] = sq2;
+                    } else {
+                        mapKK[idx][sq2] = code++;
+                    }
+                }
+            }
+        for (int i = 0; i < bothOnDiagonalCount; i++) mapKK[bothOnDiagonal[i][0]][bothOnDiagonal[i][1]] = code++;
+
+        binomial[0][0] = 1;
+        for (int n = 1; n < SQUARES; n++)
+            for (int k = 0; k < 6 && k <= n; k++)
+                binomial[k][n] = (k > 0 ? binomial[k - 1][n - 1] : 0) + (k < n ? binomial[k][n - 1] : 0);
+
+        // mapPawns encodes A2-H7 to 0..47, the leading pawn has the highest value. leadPawnIdx and leadPawnsSize
+        // index the placements of up to 5 leading pawns, restarting at every file since the tables are split by file.
+        int availableSquares = 47;
+        for (int leadPawns = 1; leadPawns <= 5; leadPawns++)
+            for (int file = FILE_A; file <= FILE_D; file++) {
+                int idx = 0;
+                for (int rank = 1; rank <= 6; rank++) {
+                    int sq = rank * 8 + file;
+                    if (leadPawns == 1) {
+                        mapPawns[sq] = availableSquares--;
+                        mapPawns[sq ^ 7] = availableSquares--;
+                    }
+                    leadPawnIdx[leadPawns][sq] = idx;
+                    idx += binomial[leadPawns - 1][mapPawns[sq]];
+                }
+                leadPawnsSize[leadPawns][file] = idx;
+            }
+    }
+
+    for (int i = 0; i < tablebaseCount; i++) {
+        releaseTablebase(&wdlTables[i]);
+        releaseTablebase(&dtzTables[i]);
+    }
+    free(wdlTables);
+    free(dtzTables);
+    wdlTables = dtzTables = nullptr;
+    memset(hashTable, 0, sizeof(hashTable));
+    tablebaseCount = largestTablebase = 0;
+
+    snprintf(tablebasePaths, sizeof(tablebasePaths), "%s", paths ? paths : "");
+    if (!*tablebasePaths || strcmp(tablebasePaths, "<empty>") == 0) return;
+
+    wdlTables = calloc(MAX_TABLEBASES, sizeof(TablebaseTable));
+    dtzTables = calloc(MAX_TABLEBASES, sizeof(TablebaseTable));
+
+    // Only the existence of the WDL file is checked
+    for (PieceType p1 = PAWN; p1 < KING; p1++) {
+        addTablebase((PieceType[]) {KING, p1, KING}, 3);
+        for (PieceType p2 = PAWN; p2 <= p1; p2++) {
+            addTablebase((PieceType[]) {KING, p1, p2, KING}, 4);
+            addTablebase((PieceType[]) {KING, p1, KING, p2}, 4);
+            for (PieceType p3 = PAWN; p3 < KING; p3++)
+                addTablebase((PieceType[]) {KING, p1, p2, KING, p3}, 5);
+            for (PieceType p3 = PAWN; p3 <= p2; p3++) {
+                addTablebase((PieceType[]) {KING, p1, p2, p3, KING}, 5);
+                for (PieceType p4 = PAWN; p4 <= p3; p4++) {
+                    addTablebase((PieceType[]) {KING, p1, p2, p3, p4, KING}, 6);
+                    for (PieceType p5 = PAWN; p5 <= p4; p5++)
+                        addTablebase((PieceType[]) {KING, p1, p2, p3, p4, p5, KING}, 7);
+                    for (PieceType p5 = PAWN; p5 < KING; p5++)
+                        addTablebase((PieceType[]) {KING, p1, p2, p3, p4, KING, p5}, 7);
+                }
+                for (PieceType p4 = PAWN; p4 < KING; p4++) {
+                    addTablebase((PieceType[]) {KING, p1, p2, p3, KING, p4}, 6);
+                    for (PieceType p5 = PAWN; p5 <= p4; p5++)
+                        addTablebase((PieceType[]) {KING, p1, p2, p3, KING, p4, p5}, 7);
+                }
+            }
+            for (PieceType p3 = PAWN; p3 <= p1; p3++)
+                for (PieceType p4 = PAWN; p4 <= (p1 == p3 ? p2 : p3); p4++)
+                    addTablebase((PieceType[]) {KING, p1, p2, KING, p3, p4}, 6);
+        }
+    }
+    printf("info string found %d tablebases\n", tablebaseCount);
+}
+
+WDLScore probeWDL(ChessBoard *restrict board, ProbeState *restrict result) {
+    *result = PROBE_OK;
+    return searchZeroingMoves(board, result, false);
+}
+
+// Returns the distance to zeroing the fifty-move counter, relative to the side to move:
+//         n < -100 : loss, but draw under the fifty-move rule
+// -100 <= n < -1   : loss in n plies
+//        -1        : loss, the side to move is mated
+//         0        : draw
+//     1 < n <= 100 : win in n plies
+//   100 < n        : win, but draw under the fifty-move rule
+// The value can be off by one ply, so a move must keep dtz + halfmove clock <= 99 to be certainly winning
+int probeDTZ(ChessBoard *restrict board, ProbeState *restrict result) {
+    *result = PROBE_OK;
+    WDLScore wdl = searchZeroingMoves(board, result, true);
+    if (*result == PROBE_FAIL || wdl == WDL_DRAW) return 0;
+    if (*result == PROBE_ZEROING_BEST_MOVE) return dtzBeforeZeroing(wdl);
+
+    int dtz = probeTablebase(board, TB_DTZ, wdl, result);
+    if (*result == PROBE_FAIL) return 0;
+    if (*result != PROBE_CHANGE_STM) return (dtz + 100 * (wdl == WDL_BLESSED_LOSS || wdl == WDL_CURSED_WIN)) * signOf(wdl);
+
+    // The table stores the other side to move, so search one ply for the move minimizing the DTZ
+    MoveObject moveList[MAX_MOVES];
+    MoveObject *endList = createMoveList(board, moveList, LEGAL);
+    int minDTZ = 0xFFFF;
+    for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) {
+        Move move = moveObj->move;
+        bool zeroing = isCapture(board, move) || getPieceType(board, getFromSquare(move)) == PAWN;
+
+        makeMove(board, nullptr, move);
+        dtz = zeroing ? -dtzBeforeZeroing(searchZeroingMoves(board, result, false)) : -probeDTZ(board, result);
+        if (dtz == 1 && getCheckers(board) && !anyLegalMoves(board)) minDTZ = 1;
+        if (!zeroing) dtz += signOf(dtz);
+        if (dtz < minDTZ && signOf(dtz) == signOf(wdl)) minDTZ = dtz;
+        undoMove(board, move);
+
+        if (*result == PROBE_FAIL) return 0;
+    }
+    return minDTZ == 0xFFFF ? -1 : minDTZ;
+}
+
+// Certain wins are ranked equally, losing moves as well unless a fifty-move draw is in sight
+static bool rankRootMovesByDTZ(ChessBoard *restrict board, const MoveObject *restrict moveList, int moves, int *restrict ranks) {
+    ProbeState result = PROBE_OK;
+    int halfmoveClock = board->history->halfmoveClock;
+    bool repetition = isRepetition(board);
+
+    for (int i = 0; i < moves; i++) {
+        Move move = moveList[i].move;
+        int dtz;
+        makeMove(board, nullptr, move);
+        if (!board->history->halfmoveClock) {
+            dtz = dtzBeforeZeroing(-probeWDL(board, &result));
+        } else if (isDraw(board)) {
+            dtz = 0;
+        } else {
+            dtz = -probeDTZ(board, &result);
+            dtz = dtz > 0 ? dtz + 1 : dtz < 0 ? dtz - 1 : dtz;
+        }
+        if (getCheckers(board) && dtz == 2 && !anyLegalMoves(board)) dtz = 1;
+        undoMove(board, move);
+
+        if (result == PROBE_FAIL) return false;
+        ranks[i] = dtz > 0 ? (dtz + halfmoveClock <= 99 && !repetition ? MAX_DTZ : MAX_DTZ - (dtz + halfmoveClock))
+                 : dtz < 0 ? (-dtz * 2 + halfmoveClock < 100 ? -MAX_DTZ : -MAX_DTZ + (-dtz + halfmoveClock))
+                 : 0;
+    }
+    return true;
+}
+
+static bool rankRootMovesByWDL(ChessBoard *restrict board, const MoveObject *restrict moveList, int moves, int *restrict ranks) {
+    constexpr int WDL_TO_RANK[] = {-MAX_DTZ, -MAX_DTZ + 101, 0, MAX_DTZ - 101, MAX_DTZ};
+    ProbeState result;
+    for (int i = 0; i < moves; i++) {
+        makeMove(board, nullptr, moveList[i].move);
+        WDLScore wdl = -probeWDL(board, &result);
+        undoMove(board, moveList[i].move);
+        if (result == PROBE_FAIL) return false;
+        ranks[i] = WDL_TO_RANK[wdl + 2];
+    }
+    return true;
+}
+
+int filterRootMoves(ChessBoard *restrict board, Move *restrict rootMoves) {
+    int ranks[MAX_MOVES];
+    MoveObject moveList[MAX_MOVES];
+    int moves = createMoveList(board, moveList, LEGAL) - moveList;
+    if (!rankRootMovesByDTZ(board, moveList, moves, ranks) && !rankRootMovesByWDL(board, moveList, moves, ranks)) return 0;
+
+    int bestRank = -MAX_DTZ, kept = 0;
+    for (int i = 0; i < moves; i++) bestRank = max(bestRank, ranks[i]);
+    for (int i = 0; i < moves; i++)
+        if (ranks[i] == bestRank) rootMoves[kept++] = moveList[i].move;
+    return kept;
+}
@@ -0,0 +1,32 @@
+#ifndef SYZYGY_H
+#define SYZYGY_H
+
+#include "chess_board.h"
+#include "utility.h"
+
+// Scores are relative to the side to move. Cursed wins and blessed losses are draws under the fifty-move rule.
+typedef enum WDLScore {
+    WDL_LOSS = -2, WDL_BLESSED_LOSS, WDL_DRAW, WDL_CURSED_WIN, WDL_WIN
+} WDLScore;
+
+typedef enum ProbeState {
+    PROBE_CHANGE_STM = -1, // DTZ table stores the other side to move
+    PROBE_FAIL,
+    PROBE_OK,
+    PROBE_ZEROING_BEST_MOVE // Best move zeroes the fifty-move counter
+} ProbeState;
+
+// Largest number of pieces (kings included) found in the tablebase files, 0 if none were found
+extern int largestTablebase;
+
+// Paths are separated by ':' (';' on Windows). Files are only memory-mapped on their first probe.
+void initializeSyzygy(const char *restrict paths);
+
+// The board is restored before returning
+WDLScore probeWDL(ChessBoard *restrict board, ProbeState *restrict result);
+int probeDTZ(ChessBoard *restrict board, ProbeState *restrict result);
+
+// Keeps only the root moves that preserve the best tablebase result, returns the number of moves kept or 0 on failure
+int filterRootMoves(ChessBoard *restrict board, Move *restrict rootMoves);
+
+#endif
@@ -0,0 +1,49 @@
+#include <stdio.h>
+
+#include "attacks.h"
+#include "chess_board.h"
+#include "search.h"
+#include "transposition_table.h"
+
+// Quiet, tactical and endgame positions, none of them in check
+static const char *positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4",
+    "rnbqkb1r/ppp1pppp/5n2/3p4/2PP4/8/PP2PPPP/RNBQKBNR w KQkq - 1 3",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+};
+
+static SearchThread st;
+static ChessBoardHistory histories[MAX_HISTORY];
+
+// The score of quiescenceEvaluation must not change after a search has filled the TT
+int main() {
+    initializeAttacks();
+    initializeChessBoard();
+    TT tt = {0};
+    createTranspositionTable(&tt, 16);
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+        ChessBoard board = {0};
+        Accumulator accumulator;
+        parseFEN(&board, histories, &accumulator, positions[i]);
+        clearTranspositionTable(&tt);
+        createSearchThread(&st, &board, &tt, UINT64_MAX, 1, false);
+
+        Score emptyTT = quiescenceEvaluation(&st);
+        st.maxDepth = 6;
+        startSearch(&st);
+        Score filledTT = quiescenceEvaluation(&st);
+
+        if (emptyTT != filledTT) {
+            printf("FAIL %s: %d with an empty TT, %d after a search\n", positions[i], emptyTT, filledTT);
+            failures++;
+        }
+    }
+    destroyTranspositionTable(&tt);
+    printf("%s\n", failures ? "quiescence evaluation test failed" : "quiescence evaluation test passed");
+    return failures != 0;
+}
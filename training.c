@@ -3,57 +3,122 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 #include "training.h"
 #include "chess_board.h"
 #include "search.h"
 #include "transposition_table.h"
 #include "utility.h"
 #include "move_generator.h"
+#include "nnue.h"
+#include "polyglot.h"
+#include "training_data.h"
 
-constexpr int MAX_RANDOM_MOVES = 10;
+constexpr int MAX_RANDOM_PLIES = 64;
+constexpr int MAX_GAME_PLIES   = 1024; // Longer games are adjudicated as a draw
+constexpr int MAX_OPENING_ATTEMPTS = 64;  // The last attempt is played even if it is rejected
+constexpr int OPENING_KEYS         = 1 << 22;
+constexpr int OPENING_KEY_PROBES   = 16;
+constexpr int WRITE_BUFFER_POSITIONS = 32768;     // 1 MB per thread
+constexpr int SHARD_POSITIONS        = 1 << 22;   // 128 MB per shard
+constexpr char TRAINING_DIRECTORY[]  = "training_data";
 
+// Positions are collected in a private buffer and written in large chunks to the thread's current shard.
+// A shard is written under a ".part" name and renamed once full, so finished shards become visible while training runs.
 typedef struct TrainingThread {
     SearchThread st;
     pthread_t id;
     uint64_t seed;
     FILE *file;
+    int thIndex;
+    int shard;
+    uint64_t shardPositions;
+    size_t buffered;
+    PackedPosition buffer[WRITE_BUFFER_POSITIONS];
+    PackedPosition gamePositions[MAX_GAME_PLIES]; // Positions of the current game, waiting for its result
 } TrainingThread;
 
 static TrainingThread tth[32]; // TODO
 static TT transpositionTable[32]; // TODO
 static atomic_bool stop;
+static atomic_uint_fast64_t gamesStarted;
 static int activeThreads;
+static uint64_t runId;
+static TrainingConfiguration limits;
+static _Atomic Key *openingKeys; // Shared set of every opening played, 0 marks an empty slot
+static char (*openings)[128];    // FENs from the EPD file
+static size_t openingsCount;
 
-typedef struct GameData {
-    struct GameData *prev;
-    Score score;
-    char fen[128];
-} GameData;
+static void getShardName(const TrainingThread *restrict tt, char *restrict filename, size_t size, bool part) {
+    snprintf(filename, size, "%s/%llu_%02d_%04d.bin%s", TRAINING_DIRECTORY, runId, tt->thIndex, tt->shard, part ? ".part" : "");
+}
+
+// Returns false if the shard cannot be written, the thread is left without a file
+static bool openShard(TrainingThread *tt) {
+    char filename[128];
+    getShardName(tt, filename, sizeof(filename), true);
+    tt->file = fopen(filename, "wb");
+    tt->shardPositions = 0;
+    if (!tt->file) {
+        printf("info string could not open %s for writing\n", filename);
+        return false;
+    }
+    setvbuf(tt->file, nullptr, _IONBF, 0); // Already buffered by the thread
+    return true;
+}
+
+static void closeShard(TrainingThread *tt) {
+    char part[128], filename[128];
+    if (!tt->file) return;
+    fclose(tt->file);
+    tt->file = nullptr;
+    getShardName(tt, part, sizeof(part), true);
+    getShardName(tt, filename, sizeof(filename), false);
+    if (tt->shardPositions) rename(part, filename);
+    else remove(part);
+    tt->shard++;
+}
 
-// Score parameter is relative to the side to move
-static void createGameData(GameData *current, GameData *previous, const ChessBoard *restrict board, Score score) {
-    current->prev  = previous;
-    current->score = board->sideToMove ? -score : score;
-    getFEN(board, current->fen);
+// A shard that could not be written in full is removed rather than finished, the thread is left without a file
+static void discardShard(TrainingThread *tt) {
+    char part[128];
+    fclose(tt->file);
+    tt->file = nullptr;
+    getShardName(tt, part, sizeof(part), true);
+    remove(part);
+    printf("info string could not write %s, shard discarded\n", part);
 }
 
-// Outcome of the game is relative to white (1.0 == white won, 0.5 == draw, 0.0 == black won)
-static int writeGameData(const GameData *restrict data, FILE *restrict file, double outcome) {
-    int positions = 0;
-    // A dummy node is placed at the end, this node can be found by checking if it leads to null in prev
-    while (data->prev) {
-        positions++;
-        fprintf(file, "%s | %d | %.1f\n", data->fen, data->score, outcome);
-        data = data->prev;
+static void flushTrainingBuffer(TrainingThread *tt) {
+    if (!tt->file) return;
+    size_t written = fwrite(tt->buffer, sizeof(tt->buffer[0]), tt->buffered, tt->file);
+    if (written != tt->buffered) {
+        tt->buffered = 0;
+        discardShard(tt);
+        return;
+    }
+    tt->shardPositions += tt->buffered;
+    tt->buffered = 0;
+    if (tt->shardPositions >= SHARD_POSITIONS) {
+        closeShard(tt);
+        openShard(tt);
     }
-    return positions;
 }
 
-static inline void swap(MoveObject *mo1, MoveObject *mo2) {
-    MoveObject temp = *mo1;
-    *mo1 = *mo2;
-    *mo2 = temp;
+// Outcome of the game is relative to white (2 == white won, 1 == draw, 0 == black won)
+static void writeGameData(TrainingThread *tt, int positions, uint8_t outcome) {
+    for (int i = 0; i < positions; i++) {
+        tt->gamePositions[i].result = outcome;
+        tt->buffer[tt->buffered++] = tt->gamePositions[i];
+        if (tt->buffered == WRITE_BUFFER_POSITIONS) flushTrainingBuffer(tt);
+    }
 }
 
 static inline bool isCheckmate(Score score) {
@@ -68,118 +133,230 @@ static inline bool isEndOfGame(const ChessBoard *restrict board, const MoveObjec
     return isCheckmate(moveObj->score) || isStalemate(moveObj->score, moveObj->move) || isDraw(board);
 }
 
-static void playRandomMoves(ChessBoard *board, ChessBoardHistory *history, TrainingThread *tt) {
-    int numberOfRandomMoves = random64BitNumber(&tt->seed) % 6 + 5;
+static void playRandomMoves(ChessBoard *board, TrainingThread *tt) {
+    int range = limits.maxRandomPlies - limits.minRandomPlies + 1;
+    int numberOfRandomMoves = random64BitNumber(&tt->seed) % range + limits.minRandomPlies;
     for (int i = 0; i < numberOfRandomMoves; i++) {
-        MoveObject moveList[MAX_MOVES];
-        MoveObject *startList = moveList;
-        MoveObject *endList = createMoveList(board, moveList, CAPTURES);
-        endList = createMoveList(board, endList, NON_CAPTURES);
-        size_t moveListSize = endList - startList;
-        while (moveListSize) {
-            MoveObject *moveObj = &startList[random64BitNumber(&tt->seed) % moveListSize];
-            Move move = moveObj->move;
-            if (isLegalMove(board, move)) {
-                makeMove(board, &history[i], nullptr, move);
-                break;
-            }
-            moveListSize--;
-            swap(startList++, moveObj);
+        Move bookMove = probeBook(board, &tt->seed);
+        if (bookMove) {
+            makeMove(board, nullptr, bookMove);
+            continue;
         }
+        MoveObject moveList[MAX_MOVES];
+        size_t moveListSize = createMoveList(board, moveList, LEGAL) - moveList;
+        if (moveListSize) makeMove(board, nullptr, moveList[random64BitNumber(&tt->seed) % moveListSize].move);
     }
 }
 
-static void playGame(TrainingThread *tt, GameData *restrict previous) {
+static inline bool isNoisy(const ChessBoard *restrict board, Move move) {
+    return getPiece(board, getToSquare(move)) || getMoveType(move) & (EN_PASSANT | PROMOTION);
+}
+
+// Drops positions the trainer would learn little from, the cheap checks run first
+static bool isFilteredPosition(TrainingThread *tt, const MoveObject *restrict bestMove) {
+    const ChessBoard *board = &tt->st.board;
+
+    /* 1) Checks, Mates and Dead Positions */
+    if (getCheckers(board) || isCheckmate(bestMove->score) || insufficientMaterial(board)) return true;
+
+    /* 2) Opening */
+    if (board->ply < limits.minPly) return true;
+
+    /* 3) Noisy Best Move */
+    if (limits.filterNoisy && isNoisy(board, bestMove->move)) return true;
+
+    /* 4) Tactical Position */
+    if (limits.qsearchMargin >= 0) {
+        Score staticEvaluation = evaluation(&tt->st.accumulators[0], board->sideToMove);
+        Score difference = quiescenceEvaluation(&tt->st) - staticEvaluation;
+        if (difference > limits.qsearchMargin || difference < -limits.qsearchMargin) return true;
+    }
+    return false;
+}
+
+// Scores are relative to white, the counters track how long the game has been decided or dead drawn
+static inline bool isAdjudicated(const ChessBoard *restrict board, Score score, int *restrict winPlies, int *restrict drawPlies, uint8_t *restrict outcome) {
+    *winPlies  = score >=  limits.winScore ? max(*winPlies, 0) + 1
+               : score <= -limits.winScore ? min(*winPlies, 0) - 1 : 0;
+    *drawPlies = board->ply >= limits.drawMinPly && score <= limits.drawScore && score >= -limits.drawScore ? *drawPlies + 1 : 0;
+    if (limits.winPlies && (*winPlies >= limits.winPlies || *winPlies <= -limits.winPlies)) {
+        *outcome = *winPlies > 0 ? 2 : 0;
+        return true;
+    }
+    if (limits.drawPlies && *drawPlies >= limits.drawPlies) {
+        *outcome = 1;
+        return true;
+    }
+    return false;
+}
+
+// Plays the game out from the searched position, the history and positions live in the thread's own buffers
+static void playGame(TrainingThread *tt) {
     ChessBoard *board = &tt->st.board;
-    ChessBoardHistory history;
-    GameData current;
-    MoveObject *bestMove = startSearch(&tt->st);
-    if (!getCheckers(board) && !isCheckmate(bestMove->score) && !insufficientMaterial(board)) { // TODO: What positions to save?
-        createGameData(&current, previous, board, bestMove->score);
-        previous = &current;
-    }
-    if (isEndOfGame(board, bestMove)) {
-        double outcome = 0.5;
-        if (isCheckmate(bestMove->score)) {
-            Colour winner = bestMove->score > 0 ? board->sideToMove : !board->sideToMove;
-            outcome = winner ? 0.0 : 1.0;
+    int positions = 0, winPlies = 0, drawPlies = 0;
+    uint8_t outcome = 1;
+    for (int ply = 0; ply < MAX_GAME_PLIES; ply++) {
+        MoveObject *bestMove = startSearch(&tt->st);
+        Score score = board->sideToMove ? -bestMove->score : bestMove->score;
+        if (!isFilteredPosition(tt, bestMove))
+            packPosition(&tt->gamePositions[positions++], board, score);
+        if (isEndOfGame(board, bestMove)) {
+            if (isCheckmate(bestMove->score)) outcome = score > 0 ? 2 : 0;
+            break;
         }
-        writeGameData(previous, tt->file, outcome);
+        if (isAdjudicated(board, score, &winPlies, &drawPlies, &outcome)) break;
+        makeMove(board, &tt->st.accumulators[0], bestMove->move);
+        compactHistory(board, tt->st.histories);
+    }
+    writeGameData(tt, positions, outcome);
+}
+
+// Returns false if the key was already in the set. When the probed slots are full the opening is treated as new.
+static bool insertOpeningKey(Key key) {
+    for (int i = 0; i < OPENING_KEY_PROBES; i++) {
+        _Atomic Key *slot = &openingKeys[(key + i) & (OPENING_KEYS - 1)];
+        Key expected = 0;
+        if (atomic_compare_exchange_strong_explicit(slot, &expected, key, memory_order_relaxed, memory_order_relaxed)) return true;
+        if (expected == key) return false;
+    }
+    return true;
+}
+
+// Keeps the first four fields of each line (placement, side to move, castling, en passant)
+static void loadOpenings(const char *restrict filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        printf("info string could not open %s\n", filename);
         return;
     }
-    makeMove(board, &history, nullptr, bestMove->move);
-    playGame(tt, previous);
+    size_t capacity = 1024;
+    char line[512];
+    openings = malloc(capacity * sizeof(openings[0]));
+    while (fgets(line, sizeof(line), file)) {
+        int fields = 0;
+        line[strcspn(line, "\r\n")] = '\0';
+        for (char *ch = line; *ch && fields < 4; ch++)
+            if (*ch == ' ' && ++fields == 4) *ch = '\0';
+        if (fields < 3) continue;
+        if (openingsCount == capacity) openings = realloc(openings, (capacity *= 2) * sizeof(openings[0]));
+        snprintf(openings[openingsCount++], sizeof(openings[0]), "%.120s 0 1", line);
+    }
+    fclose(file);
+    printf("info string loaded %zu openings from %s\n", openingsCount, filename);
+}
+
+// Plays random plies from the start position or an EPD opening, following the book while the position is in it.
+// Openings that were already played, have no legal moves or score outside the window of a shallow search are replaced.
+static void generateOpening(TrainingThread *tt, ChessBoard *restrict board, ChessBoardHistory *restrict history) {
+    for (int attempt = 1; attempt <= MAX_OPENING_ATTEMPTS; attempt++) {
+        parseFEN(board, history, nullptr, openingsCount ? openings[random64BitNumber(&tt->seed) % openingsCount] : START_POS);
+        playRandomMoves(board, tt);
+        if (!anyLegalMoves(board) || !insertOpeningKey(getPositionKey(board))) continue;
+        if (limits.openingWindow < 0) return;
+
+        createSearchThread(&tt->st, board, tt->st.tt, UINT64_MAX, 1, false);
+        tt->st.maxDepth = limits.openingDepth;
+        MoveObject *bestMove = startSearch(&tt->st);
+        // The game starts from an empty TT like every other game. The correction history is kept,
+        // it is a running average over positions and already carries over from game to game.
+        clearTranspositionTable(tt->st.tt);
+        if (bestMove->score <= limits.openingWindow && bestMove->score >= -limits.openingWindow) return;
+    }
 }
 
-// Randomly plays the first 5-10 moves
 static void playRandomGame(TrainingThread *tt) {
     ChessBoard board = {0};
-    ChessBoardHistory history[MAX_RANDOM_MOVES + 1] = {0};
-    GameData dummy = {.prev = nullptr};
-    parseFEN(&board, history, nullptr, START_POS);
-    playRandomMoves(&board, &history[1], tt);
-    createSearchThread(&tt->st, &board, tt->st.tt, 1000000000 / 2, false);
-    playGame(tt, &dummy); // TODO: Is it safe to write data for position that randomly is draw?
+    ChessBoardHistory history[MAX_RANDOM_PLIES + 1] = {0};
+    generateOpening(tt, &board, history);
+    bool fixedSearch = limits.softNodes || limits.hardNodes || limits.depth;
+    createSearchThread(&tt->st, &board, tt->st.tt, fixedSearch ? UINT64_MAX : 1000000000 / 2, 1, false);
+    tt->st.softNodes = limits.softNodes;
+    tt->st.hardNodes = limits.hardNodes;
+    if (limits.depth) tt->st.maxDepth = limits.depth;
+    playGame(tt); // TODO: Is it safe to write data for position that randomly is draw?
+}
+
+static inline bool startNextGame() {
+    if (atomic_load_explicit(&stop, memory_order_relaxed)) return false;
+    return !limits.games || atomic_fetch_add_explicit(&gamesStarted, 1, memory_order_relaxed) < limits.games;
 }
 
+// The thread writes out its own data once it has no games left to play, or stops early if its shard cannot be opened or written
 static void* startTraining(void *trainingThread) {
     TrainingThread *tt = trainingThread;
-    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+    while (tt->file && startNextGame()) {
         playRandomGame(tt);
         clearTranspositionTable(tt->st.tt);
     }
+    flushTrainingBuffer(tt);
+    closeShard(tt);
+    if (!atomic_load_explicit(&stop, memory_order_relaxed)) printf("info string thread: %d, finished\n", tt->thIndex);
     return nullptr;
 }
 
-static void startTrainingThread(TrainingThread *restrict tthr, uint64_t seed, const char *restrict filename) {
-    tthr->seed = seed;
-    tthr->file = fopen(filename, "ab+");
+// The first shard has already been opened
+static void startTrainingThread(TrainingThread *tthr, uint64_t seed) {
+    tthr->seed     = seed;
+    tthr->buffered = 0;
     pthread_create(&tthr->id, nullptr, startTraining, tthr);
 }
 
-static void stopTrainingThread(TrainingThread *tthr, FILE *restrict merge, int thIndex) {
+// The thread has already written its data, there is nothing to merge
+static void stopTrainingThread(TrainingThread *tthr) {
     pthread_join(tthr->id, nullptr);
     destroyTranspositionTable(tthr->st.tt);
-    fflush(tthr->file);
-    rewind(tthr->file);
-
-    size_t read;
-    char data[2048];
-    while ((read = fread(data, sizeof(data[0]), sizeof(data), tthr->file)))
-        fwrite(data, sizeof(data[0]), read, merge);
-
-    fclose(tthr->file);
-    snprintf(data, sizeof(data), "training_data%02d.txt", thIndex);
-    remove(data);
 }
 
-void startTrainingThreads(const UCI_Configuration *restrict config) {
+void startTrainingThreads(const UCI_Configuration *restrict config, const TrainingConfiguration *restrict training) {
     if (activeThreads) stopTrainingThreads();
+    runId = time(nullptr); // Keeps shards of earlier runs from being overwritten
+#ifdef _WIN32
+    _mkdir(TRAINING_DIRECTORY);
+#else
+    mkdir(TRAINING_DIRECTORY, 0755);
+#endif
+    // Every thread needs somewhere to write before any of them starts
+    for (int i = 0; i < config->threads; i++) {
+        tth[i].thIndex = i;
+        tth[i].shard   = 0;
+        if (!openShard(&tth[i])) {
+            while (i--) closeShard(&tth[i]);
+            puts("info string training not started");
+            return;
+        }
+    }
+
     activeThreads = config->threads;
+    limits = *training;
+    limits.maxRandomPlies = min(limits.maxRandomPlies, MAX_RANDOM_PLIES);
+    limits.minRandomPlies = min(limits.minRandomPlies, limits.maxRandomPlies);
     printf("info string training started with %d threads\n", activeThreads);
 
     atomic_store_explicit(&stop, false, memory_order_relaxed);
-    uint64_t seed = time(nullptr);
-    char filename[32];
+    atomic_store_explicit(&gamesStarted, 0, memory_order_relaxed);
+    openingKeys = calloc(OPENING_KEYS, sizeof(openingKeys[0]));
+    if (limits.openingFile) loadOpenings(limits.openingFile);
+    uint64_t seed = limits.seed ? limits.seed : runId;
     for (int i = 0; i < activeThreads; i++) {
         uint64_t random = splitMix64(&seed);
         random = random64BitNumber(&random);
-        snprintf(filename, sizeof(filename), "training_data%02d.txt", i); // TODO: Make directory
         tth[i].st.tt = &transpositionTable[i];
         createTranspositionTable(&transpositionTable[i], config->hashSize);
-        startTrainingThread(&tth[i], random, filename);
+        startTrainingThread(&tth[i], random);
     }
 }
 
 void stopTrainingThreads() {
     if (!activeThreads) return;
     atomic_store_explicit(&stop, true, memory_order_relaxed);
-    FILE *merge = fopen("training_data.txt", "a");
     for (int i = 0; i < activeThreads; i++) {
         printf("info string stopping thread: %d\n", i);
-        stopTrainingThread(&tth[i], merge, i);
+        stopTrainingThread(&tth[i]);
         printf("info string thread: %d, stopped\n", i);
     }
-    fclose(merge);
+    free(openingKeys);
+    free(openings);
+    openings = nullptr;
+    openingsCount = 0;
     activeThreads = 0;
 }
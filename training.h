@@ -1,9 +1,37 @@
 #ifndef TRAINING_H
 #define TRAINING_H
 
+#include <stdint.h>
 #include "uci.h"
+#include "utility.h"
 
-void startTrainingThreads(const UCI_Configuration *restrict config);
+// Without a node or depth limit every search gets half a second
+typedef struct TrainingConfiguration {
+    uint64_t softNodes;
+    uint64_t hardNodes;
+    uint64_t games; // 0 plays until stopped
+    uint64_t seed;  // 0 seeds from the clock
+    Depth depth;
+    uint8_t minRandomPlies;
+    uint8_t maxRandomPlies;
+    // A game is adjudicated once the score stays past winScore (for one side) or within drawScore for the given plies, 0 plies disables
+    Score winScore;
+    Score drawScore;
+    uint16_t drawMinPly;
+    uint8_t winPlies;
+    uint8_t drawPlies;
+    // Positions are only saved from minPly on, when the best move is quiet (if filterNoisy)
+    // and when the quiescence score is within qsearchMargin of the static evaluation (negative disables)
+    uint16_t minPly;
+    Score qsearchMargin;
+    bool filterNoisy;
+    // Openings come from the EPD file when given, and must score within openingWindow at openingDepth (negative disables)
+    const char *openingFile;
+    Score openingWindow;
+    Depth openingDepth;
+} TrainingConfiguration;
+
+void startTrainingThreads(const UCI_Configuration *restrict config, const TrainingConfiguration *restrict training);
 void stopTrainingThreads();
 
 #endif
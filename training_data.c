@@ -0,0 +1,163 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "training_data.h"
+#include "chess_board.h"
+#include "utility.h"
+
+constexpr int PACKED_STM_SHIFT    = 4;
+
+void packPosition(PackedPosition *restrict position, const ChessBoard *restrict board, Score score) {
+    *position = (PackedPosition) {0};
+    Bitboard occupied  = getOccupiedSquares(board);
+    position->occupied = occupied;
+    for (int i = 0; occupied; i++) {
+        uint8_t nibble = getPiece(board, bitboardToSquareWithReset(&occupied)); // Same encoding as the mailbox
+        position->pieces[i >> 1] |= nibble << ((i & 1) * 4);
+    }
+    position->score           = score;
+    position->flags           = board->history->castlingRights | board->sideToMove << PACKED_STM_SHIFT;
+    position->enPassant       = board->history->enPassant;
+    position->halfmoveClock   = board->history->halfmoveClock;
+    position->fullmoveCounter = board->ply / 2 + (board->sideToMove == WHITE);
+}
+
+void unpackPosition(const PackedPosition *restrict position, char *restrict fen) {
+    constexpr char NIBBLE_TO_CHAR[] = " PNBRQK  pnbrqk";
+    constexpr char CASTLING_RIGHTS_TO_CHAR[] = {
+        [WHITE_QUEENSIDE] = 'Q', [BLACK_QUEENSIDE] = 'q',
+        [WHITE_KINGSIDE]  = 'K', [BLACK_KINGSIDE]  = 'k'
+    };
+
+    uint8_t mailbox[SQUARES] = {0};
+    Bitboard occupied = position->occupied;
+    for (int i = 0; occupied; i++)
+        mailbox[bitboardToSquareWithReset(&occupied)] = position->pieces[i >> 1] >> ((i & 1) * 4) & 0xF;
+
+    /* 1) Piece Placement */
+    int empty = 0;
+    for (Square sq = A8; sq <= H1; sq++) {
+        if (mailbox[sq]) {
+            if (empty) *fen++ = '0' + empty;
+            empty = 0;
+            *fen++ = NIBBLE_TO_CHAR[mailbox[sq]];
+        } else {
+            empty++;
+        }
+        if (squareToBitboard(sq) & FILE_H_BB) {
+            if (empty) *fen++ = '0' + empty;
+            empty = 0;
+            if (sq != H1) *fen++ = '/';
+        }
+    }
+
+    /* 2) Side to Move */
+    *fen++ = ' ';
+    *fen++ = position->flags >> PACKED_STM_SHIFT ? 'b' : 'w';
+    *fen++ = ' ';
+
+    /* 3) Castling Ability */
+    CastlingRights castlingRights = position->flags & ALL_RIGHTS;
+    if (castlingRights) {
+        for (CastlingRights cr = WHITE_KINGSIDE; cr <= BLACK_QUEENSIDE; cr <<= 1)
+            if (castlingRights & cr) *fen++ = CASTLING_RIGHTS_TO_CHAR[cr];
+    } else {
+        *fen++ = '-';
+    }
+    *fen++ = ' ';
+
+    /* 4) En Passant Target Square */
+    if (position->enPassant != NO_SQUARE) {
+        *fen++ = SQUARE_NAME[position->enPassant][0];
+        *fen++ = SQUARE_NAME[position->enPassant][1];
+    } else {
+        *fen++ = '-';
+    }
+
+    /* 5) Halfmove Clock and 6) Fullmove Counter */
+    sprintf(fen, " %u %u", position->halfmoveClock, position->fullmoveCounter);
+}
+
+static bool isBinaryFile(const char *filename) {
+    const char *extension = strrchr(filename, '.');
+    return extension && strcmp(extension, ".bin") == 0;
+}
+
+bool openTrainingData(TrainingDataReader *restrict reader, const char *restrict filename) {
+    reader->size  = 0;
+    reader->index = 0;
+    reader->text  = !isBinaryFile(filename);
+    reader->file  = fopen(filename, reader->text ? "r" : "rb");
+    return reader->file;
+}
+
+void closeTrainingData(TrainingDataReader *reader) {
+    if (reader->file) fclose(reader->file);
+    reader->file = nullptr;
+}
+
+void rewindTrainingData(TrainingDataReader *reader) {
+    rewind(reader->file);
+    reader->size  = 0;
+    reader->index = 0;
+}
+
+// Each line is expected as: fen | score | result
+static bool readTextPosition(FILE *restrict file, PackedPosition *restrict position) {
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char *separator = strstr(line, " | ");
+        if (!separator) continue;
+        *separator = '\0';
+
+        ChessBoard board;
+        ChessBoardHistory history;
+        parseFEN(&board, &history, nullptr, line);
+        char *end;
+        Score score = strtol(separator + 3, &end, 10);
+        packPosition(position, &board, score);
+        position->result = strtod(end + 3, nullptr) * 2 + 0.5;
+        return true;
+    }
+    return false;
+}
+
+bool readPackedPosition(TrainingDataReader *restrict reader, PackedPosition *restrict position) {
+    if (reader->text) return readTextPosition(reader->file, position);
+    if (reader->index == reader->size) {
+        reader->size  = fread(reader->buffer, sizeof(reader->buffer[0]), TRAINING_READER_BUFFER, reader->file);
+        reader->index = 0;
+        if (!reader->size) return false;
+    }
+    *position = reader->buffer[reader->index++];
+    return true;
+}
+
+uint64_t convertTrainingData(const char *restrict input, const char *restrict output) {
+    TrainingDataReader *reader = malloc(sizeof(TrainingDataReader));
+    uint64_t positions = 0;
+    if (!openTrainingData(reader, input)) {
+        free(reader);
+        return 0;
+    }
+    bool toText = !reader->text;
+    FILE *file = fopen(output, toText ? "w" : "wb");
+    if (file) {
+        PackedPosition position;
+        char fen[128];
+        while (readPackedPosition(reader, &position)) {
+            if (toText) {
+                unpackPosition(&position, fen);
+                fprintf(file, "%s | %d | %.1f\n", fen, position.score, position.result / 2.0);
+            } else {
+                fwrite(&position, sizeof(position), 1, file);
+            }
+            positions++;
+        }
+        fclose(file);
+    }
+    closeTrainingData(reader);
+    free(reader);
+    return positions;
+}
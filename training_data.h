@@ -0,0 +1,50 @@
+#ifndef TRAINING_DATA_H
+#define TRAINING_DATA_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "chess_board.h"
+#include "utility.h"
+
+// 32 byte training record. The pieces are stored as 4 bit nibbles (piece type | colour << 3)
+// in the order the occupied squares are popped from the occupancy (least significant bit first).
+typedef struct PackedPosition {
+    Bitboard occupied;
+    uint8_t pieces[16];
+    int16_t score;           // Relative to white
+    uint8_t result;          // Relative to white (2 == white won, 1 == draw, 0 == black won)
+    uint8_t flags;           // Castling rights | side to move << 4
+    uint8_t enPassant;
+    uint8_t halfmoveClock;
+    uint16_t fullmoveCounter;
+} PackedPosition;
+
+static_assert(sizeof(PackedPosition) == 32);
+
+constexpr int TRAINING_READER_BUFFER = 4096;
+
+// Streams packed positions from either format so the whole file never has to fit in memory.
+// Binary files (".bin") are read in large blocks, anything else is parsed line by line as text.
+typedef struct TrainingDataReader {
+    FILE *file;
+    bool text;
+    size_t size;
+    size_t index;
+    PackedPosition buffer[TRAINING_READER_BUFFER];
+} TrainingDataReader;
+
+// Score parameter is relative to white
+void packPosition(PackedPosition *restrict position, const ChessBoard *restrict board, Score score);
+void unpackPosition(const PackedPosition *restrict position, char *restrict fen);
+
+bool openTrainingData(TrainingDataReader *restrict reader, const char *restrict filename);
+void closeTrainingData(TrainingDataReader *reader);
+void rewindTrainingData(TrainingDataReader *reader);
+// Returns false once the file is exhausted
+bool readPackedPosition(TrainingDataReader *restrict reader, PackedPosition *restrict position);
+
+// Converts between the text format (fen | score | result) and the binary format, the input is read in the format its extension implies.
+// Returns the number of positions converted.
+uint64_t convertTrainingData(const char *restrict input, const char *restrict output);
+
+#endif
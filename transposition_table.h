@@ -80,6 +80,11 @@ static inline void savePositionEvaluation(TT *tt, PositionEvaluation *pe, Key po
     pe->key = positionKeyIndex;
 }
 
+// Issued before the move is made so the bucket is in cache by the time the child probes it
+static inline void prefetchTranspositionTable(const TT *tt, Key positionKey) {
+    _mm_prefetch((const char *) &tt->buckets[positionKey & tt->mask], _MM_HINT_T0);
+}
+
 // TODO: Consider thread safety
 static inline PositionEvaluation* probeTranspositionTable(const TT *tt, Key positionKey, bool *restrict hasEvaluation) {
     PositionEvaluation* pe = &tt->buckets[positionKey & tt->mask].pe[0];
@@ -5,34 +5,46 @@
 #include <stdlib.h>
 #include "uci.h"
 #include "chess_board.h"
+#include "learn.h"
 #include "move_generator.h"
 #include "nnue.h"
+#include "perft.h"
+#include "polyglot.h"
 #include "transposition_table.h"
 #include "utility.h"
 #include "search.h"
+#include "syzygy.h"
 #include "training.h"
+#include "training_data.h"
 
 // Official UCI Commands
 constexpr char GO          [] = "go"        ;
 constexpr char IS_READY    [] = "isready"   ;
+constexpr char PONDER_HIT  [] = "ponderhit" ;
 constexpr char POSITION    [] = "position"  ;
 constexpr char QUIT        [] = "quit"      ;
 constexpr char SET_OPTION  [] = "setoption" ;
+constexpr char STOP        [] = "stop"      ;
 constexpr char UCI         [] = "uci"       ;
 constexpr char UCI_NEW_GAME[] = "ucinewgame";
 
 // Unofficial UCI Commands
 constexpr char BENCHMARK[] = "benchmark";
+constexpr char CONVERT  [] = "convert"  ;
 constexpr char EVAL     [] = "eval"     ;
 constexpr char FEN      [] = "fen"      ;
+constexpr char LEARN    [] = "learn"    ;
+constexpr char PERFT    [] = "perft"    ;
 constexpr char TRAIN    [] = "train"    ;
 
-static ChessBoardHistory histories[1024]; // TODO: New design? Can use position halfmove clock to determine max size
+static ChessBoardHistory histories[MAX_HISTORY];
+static uint64_t bookSeed;
 
 static void go(UCI_Configuration *restrict config) {
     constexpr char binc [] = "binc" ;
     constexpr char btime[] = "btime";
     constexpr char depth[] = "depth";
+    constexpr char ponder[] = "ponder";
     constexpr char winc [] = "winc" ;
     constexpr char wtime[] = "wtime";
     // TODO: Options to potentially implement. All times are in msec
@@ -42,36 +54,53 @@ static void go(UCI_Configuration *restrict config) {
 
     uint64_t bIncNs, bTimeNs, wIncNs, wTimeNs, stmSearchTimeNs, searchTimeNs;
     bIncNs = bTimeNs = wIncNs = wTimeNs = stmSearchTimeNs = searchTimeNs = 0;
+    bool isPondering = false;
     char *token;
     while ((token = strtok(nullptr, " ")))
         if      (strcmp(token, binc    ) == 0) bIncNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
         else if (strcmp(token, btime   ) == 0) bTimeNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
         else if (strcmp(token, depth   ) == 0) strtok(nullptr, " ");
+        else if (strcmp(token, ponder  ) == 0) isPondering = true;
         else if (strcmp(token, winc    ) == 0) wIncNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
         else if (strcmp(token, wtime   ) == 0) wTimeNs = strtoull(strtok(nullptr, " "), nullptr, 10) * 1000000;
 
+    // A book move cannot be sent while pondering, so the book is only used on our own time
+    Move bookMove = config->ownBook && !isPondering ? probeBook(&config->board, &bookSeed) : NO_MOVE;
+    if (bookMove) {
+        char moveString[6];
+        moveToString(moveString, bookMove);
+        printf("bestmove %s\n", moveString);
+        return;
+    }
+
     stmSearchTimeNs = config->board.sideToMove ? bTimeNs / 20 + bIncNs / 2 : wTimeNs / 20 + wIncNs / 2;
     searchTimeNs = stmSearchTimeNs ? stmSearchTimeNs : 1000000000;
-    startSearchThreads(config, searchTimeNs);
+    startSearchThreads(config, searchTimeNs, isPondering);
 }
 
 static void isReady() {
     puts("readyok");
 }
 
+static void ponderHit() {
+    ponderHitSearchThreads();
+}
+
+static void stop() {
+    stopSearchThreads();
+}
+
 static void processMoves(ChessBoard *restrict board, Accumulator *restrict accumulator) {
     char *moveStr;
-    int i = 1;
     while ((moveStr = strtok(nullptr, " "))) {
         MoveObject moveList[MAX_MOVES];
-        // TODO: Make a legal move generation stage
-        MoveObject *endList = createMoveList(board, moveList, CAPTURES);
-        endList = createMoveList(board, endList, NON_CAPTURES);
+        MoveObject *endList = createMoveList(board, moveList, LEGAL);
         char moveToName[6];
         for (MoveObject *startList = moveList; startList < endList; startList++) {
             moveToString(moveToName, startList->move);
             if (strcmp(moveStr, moveToName) == 0) {
-                makeMove(board, &histories[i++], accumulator, startList->move);
+                makeMove(board, accumulator, startList->move);
+                compactHistory(board, histories);
                 break;
             }
         }
@@ -82,6 +111,7 @@ static void processMoves(ChessBoard *restrict board, Accumulator *restrict accum
 static void position(ChessBoard *restrict board, Accumulator *restrict accumulator) {
     constexpr char fen[] = "fen";
 
+    stopSearchThreads(); // The search board refers to the history being replaced
     const char *fenStr = START_POS;
     if (strcmp(strtok(nullptr, " "), fen) == 0) {
         fenStr = strtok(nullptr, " ");
@@ -93,16 +123,27 @@ static void position(ChessBoard *restrict board, Accumulator *restrict accumulat
 }
 
 static void setOption(UCI_Configuration *restrict config) {
-    constexpr char Hash   [] = "Hash"   ;
-    constexpr char Threads[] = "Threads";
+    constexpr char BookFile  [] = "BookFile"  ;
+    constexpr char Hash      [] = "Hash"      ;
+    constexpr char MultiPV   [] = "MultiPV"   ;
+    constexpr char OwnBook   [] = "OwnBook"   ;
+    constexpr char SyzygyPath[] = "SyzygyPath";
+    constexpr char Threads   [] = "Threads"   ;
 
-    
+    stopSearchThreads();
     strtok(nullptr, " "); // Discard name string
     char *token = strtok(nullptr, " ");
     strtok(nullptr, " "); // Discard value string
 
-    if      (strcmp(token, Hash   ) == 0) createTranspositionTable(&config->tt, config->hashSize = strtoull(strtok(nullptr, " "), nullptr, 10));
-    else if (strcmp(token, Threads) == 0) config->threads = strtoul(strtok(nullptr, " "), nullptr, 10);
+    if      (strcmp(token, BookFile  ) == 0) openBook(strtok(nullptr, "")); // Paths may contain spaces
+    else if (strcmp(token, Hash      ) == 0) createTranspositionTable(&config->tt, config->hashSize = strtoull(strtok(nullptr, " "), nullptr, 10));
+    else if (strcmp(token, MultiPV   ) == 0) {
+        unsigned long multiPV = strtoul(strtok(nullptr, " "), nullptr, 10);
+        config->multiPV = multiPV < 1 ? 1 : multiPV > MAX_MULTIPV ? MAX_MULTIPV : multiPV; // Clamped before it can wrap
+    }
+    else if (strcmp(token, OwnBook   ) == 0) config->ownBook = strcmp(strtok(nullptr, " "), "true") == 0;
+    else if (strcmp(token, SyzygyPath) == 0) initializeSyzygy(strtok(nullptr, "")); // Paths may contain spaces
+    else if (strcmp(token, Threads   ) == 0) config->threads = strtoul(strtok(nullptr, " "), nullptr, 10);
 }
 
 static void uci() {
@@ -110,35 +151,65 @@ static void uci() {
     puts("id author Deshawn Mohan");
     puts("option name Hash type spin default 16 min 1 max 1024"); // TODO: What to make max?
     puts("option name Threads type spin default 1 min 1 max 255");
+    printf("option name MultiPV type spin default 1 min 1 max %d\n", MAX_MULTIPV);
+    puts("option name Ponder type check default false");
+    puts("option name SyzygyPath type string default <empty>");
+    puts("option name OwnBook type check default false");
+    puts("option name BookFile type string default <empty>");
     puts("uciok");
 }
 
 static void uciNewGame(TT *restrict tt) {
+    clearSearchThreads();
     clearTranspositionTable(tt);
 }
 
-static uint64_t perft(ChessBoard *restrict board, Depth depth) {
-    uint64_t nodes = 0;
-    ChessBoardHistory history;
-    MoveObject moveList[MAX_MOVES];
-    MoveObject *endList = createMoveList(board, moveList, CAPTURES);
-    endList = createMoveList(board, endList, NON_CAPTURES);
-    if (depth == 1)
-        for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) 
-            nodes += isLegalMove(board, moveObj->move);
-    else 
-        for (MoveObject *moveObj = moveList; moveObj != endList; moveObj++) {
-            Move move = moveObj->move;
-            if (!isLegalMove(board, move)) continue;
-            makeMove(board, &history, nullptr, move);
-            nodes += perft(board, depth - 1);
-            undoMove(board, move);
-        }
-    return nodes;
+// Optional arguments: threads and perft table size in megabytes
+static void parsePerftArguments(int *restrict threads, size_t *restrict hashSize) {
+    char *token;
+    if ((token = strtok(nullptr, " "))) *threads  = strtoul(token, nullptr, 10);
+    if ((token = strtok(nullptr, " "))) *hashSize = strtoull(token, nullptr, 10);
 }
 
+// Every position of the perft suite is made and unmade iterations times, measuring the board without the tree
+static void benchmarkBoard() {
+    char *token = strtok(nullptr, " ");
+    uint64_t iterations = token ? strtoull(token, nullptr, 10) : 100;
+    FILE *perftFile = fopen("perft_test_cases.txt", "r");
+    char line[256];
+
+    double totalTime = 0.001;
+    uint64_t moves = 0;
+    printf("info string board benchmark starting, iterations: %llu\n", iterations);
+    while (fgets(line, sizeof(line), perftFile)) {
+        ChessBoard board = {0};
+        ChessBoardHistory history[MAX_HISTORY];
+        parseFEN(&board, history, nullptr, strtok(line, ","));
+
+        uint64_t start = getTimeNs();
+        moves += boardBenchmark(&board, iterations);
+        totalTime += (getTimeNs() - start) / 1e9;
+    }
+
+    printf("info string total time: %.2lf sec, moves: %llu, moves/sec: %.0lf\n", totalTime, moves, moves / totalTime);
+    fclose(perftFile);
+}
+
+// Either "board" followed by the iterations, or the perft depth
 static void benchmark() {
-    Depth depth = strtoul(strtok(nullptr, " "), nullptr, 10);
+    constexpr char boardMode[] = "board";
+    char *token = strtok(nullptr, " ");
+    if (!token) return;
+    if (strcmp(token, boardMode) == 0) {
+        benchmarkBoard();
+        return;
+    }
+    Depth depth = strtoul(token, nullptr, 10);
+    int threads = 1;
+    size_t hashSize = 0;
+    parsePerftArguments(&threads, &hashSize);
+    PerftTable table;
+    createPerftTable(&table, hashSize);
     FILE *perftFile = fopen("perft_test_cases.txt", "r");
     char line[256];
 
@@ -147,12 +218,12 @@ static void benchmark() {
     printf("info string benchmark starting, depth: %u\n", depth);
     while (fgets(line, sizeof(line), perftFile)) {
         ChessBoard board = {0};
-        ChessBoardHistory history = {0};
-        parseFEN(&board, &history, nullptr, strtok(line, ","));
+        ChessBoardHistory history[MAX_HISTORY];
+        parseFEN(&board, history, nullptr, strtok(line, ","));
 
-        clock_t start = clock(); // TODO: Consider a more accurate clock
-        actualNodes += perft(&board, depth);
-        totalTime += (double) (clock() - start) / CLOCKS_PER_SEC;
+        uint64_t start = getTimeNs(); // CPU time from clock() would add up across threads
+        actualNodes += perft(&board, depth, threads, &table, false);
+        totalTime += (getTimeNs() - start) / 1e9;
         
         for (int i = 0; i < depth - 1; i++) strtok(nullptr, ",");
         expectedNodes += strtoull(strtok(nullptr, ","), nullptr, 10);
@@ -161,6 +232,33 @@ static void benchmark() {
     printf("info string benchmark %s, expected positions: %llu, positions got: %llu\n", expectedNodes == actualNodes ? "passed" : "failed", expectedNodes, actualNodes);
     printf("info string total time: %.2lf sec, positions/sec: %.0lf\n", totalTime, actualNodes / totalTime);
     fclose(perftFile);
+    destroyPerftTable(&table);
+}
+
+// Perft of the current position, printing the nodes of each root move
+static void divide(const UCI_Configuration *restrict config) {
+    Depth depth = strtoul(strtok(nullptr, " "), nullptr, 10);
+    int threads = config->threads;
+    size_t hashSize = config->hashSize;
+    parsePerftArguments(&threads, &hashSize);
+    PerftTable table;
+    createPerftTable(&table, hashSize);
+
+    uint64_t start = getTimeNs();
+    uint64_t nodes = perft(&config->board, depth, threads, &table, true);
+    double totalTime = (getTimeNs() - start) / 1e9 + 0.001;
+    printf("\nNodes searched: %llu\n", nodes);
+    printf("info string total time: %.2lf sec, positions/sec: %.0lf\n", totalTime, nodes / totalTime);
+    destroyPerftTable(&table);
+}
+
+// Input and output filenames, a ".bin" input is converted to text and anything else to binary
+static void convert() {
+    char *input  = strtok(nullptr, " ");
+    char *output = strtok(nullptr, " ");
+    if (!input || !output) return;
+    uint64_t positions = convertTrainingData(input, output);
+    printf("info string converted %llu positions from %s to %s\n", positions, input, output);
 }
 
 static void eval(const Accumulator *restrict accumulator, Colour stm) {
@@ -173,15 +271,90 @@ static void fen(const ChessBoard *restrict board) {
     puts(fen);
 }
 
+// Optional arguments: nodes <soft> hardnodes <hard> depth <d> games <n> seed <s> randomplies <min> <max>
+// winadj <score> <plies> drawadj <score> <plies> <minimum ply> minply <n> filternoisy <true|false> qsearchmargin <score>
+// epd <filename> openingwindow <score> openingdepth <d>
 static void train(const UCI_Configuration *restrict config) {
-    startTrainingThreads(config);
+    constexpr char depth        [] = "depth"        ;
+    constexpr char drawadj      [] = "drawadj"      ;
+    constexpr char epd          [] = "epd"          ;
+    constexpr char filternoisy  [] = "filternoisy"  ;
+    constexpr char games        [] = "games"        ;
+    constexpr char hardnodes    [] = "hardnodes"    ;
+    constexpr char minply       [] = "minply"       ;
+    constexpr char nodes        [] = "nodes"        ;
+    constexpr char openingdepth [] = "openingdepth" ;
+    constexpr char openingwindow[] = "openingwindow";
+    constexpr char qsearchmargin[] = "qsearchmargin";
+    constexpr char randomplies  [] = "randomplies"  ;
+    constexpr char seed         [] = "seed"         ;
+    constexpr char winadj       [] = "winadj"       ;
+
+    TrainingConfiguration training = {
+        .minRandomPlies = 5, .maxRandomPlies = 10,
+        .winScore = 2500, .winPlies = 6,
+        .drawScore = 10, .drawPlies = 10, .drawMinPly = 80,
+        .minPly = 16, .qsearchMargin = 0, .filterNoisy = true,
+        .openingWindow = 300, .openingDepth = 6
+    };
+    char *token;
+    while ((token = strtok(nullptr, " ")))
+        if      (strcmp(token, depth        ) == 0) training.depth         = strtoul (strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, epd          ) == 0) training.openingFile   = strtok(nullptr, " ");
+        else if (strcmp(token, filternoisy  ) == 0) training.filterNoisy   = strcmp(strtok(nullptr, " "), "true") == 0;
+        else if (strcmp(token, games        ) == 0) training.games         = strtoull(strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, hardnodes    ) == 0) training.hardNodes     = strtoull(strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, minply       ) == 0) training.minPly        = strtoul (strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, nodes        ) == 0) training.softNodes     = strtoull(strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, openingdepth ) == 0) training.openingDepth  = strtoul (strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, openingwindow) == 0) training.openingWindow = strtol  (strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, qsearchmargin) == 0) training.qsearchMargin = strtol  (strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, seed         ) == 0) training.seed          = strtoull(strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, randomplies) == 0) {
+            training.minRandomPlies = strtoul(strtok(nullptr, " "), nullptr, 10);
+            training.maxRandomPlies = strtoul(strtok(nullptr, " "), nullptr, 10);
+        } else if (strcmp(token, winadj) == 0) {
+            training.winScore = strtol (strtok(nullptr, " "), nullptr, 10);
+            training.winPlies = strtoul(strtok(nullptr, " "), nullptr, 10);
+        } else if (strcmp(token, drawadj) == 0) {
+            training.drawScore  = strtol (strtok(nullptr, " "), nullptr, 10);
+            training.drawPlies  = strtoul(strtok(nullptr, " "), nullptr, 10);
+            training.drawMinPly = strtoul(strtok(nullptr, " "), nullptr, 10);
+        }
+    startTrainingThreads(config, &training);
+}
+
+// Data filename followed by the optional arguments: epochs <n> lr <rate> batch <size> wdl <weight> output <filename> init <random|current>
+static void learnNetwork(const UCI_Configuration *restrict config) {
+    constexpr char batch [] = "batch" ;
+    constexpr char epochs[] = "epochs";
+    constexpr char init  [] = "init"  ;
+    constexpr char lr    [] = "lr"    ;
+    constexpr char output[] = "output";
+    constexpr char wdl   [] = "wdl"   ;
+
+    LearnConfiguration learning = {
+        .dataFile = strtok(nullptr, " "), .outputFile = "nnue.bin",
+        .learningRate = 0.001f, .wdl = 0.25f, .epochs = 10, .batchSize = 16384, .threads = config->threads
+    };
+    if (!learning.dataFile) return;
+    char *token;
+    while ((token = strtok(nullptr, " ")))
+        if      (strcmp(token, batch ) == 0) learning.batchSize    = strtoul(strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, epochs) == 0) learning.epochs       = strtoul(strtok(nullptr, " "), nullptr, 10);
+        else if (strcmp(token, init  ) == 0) learning.randomInitialization = strcmp(strtok(nullptr, " "), "random") == 0;
+        else if (strcmp(token, lr    ) == 0) learning.learningRate = strtof (strtok(nullptr, " "), nullptr);
+        else if (strcmp(token, output) == 0) learning.outputFile   = strtok(nullptr, " ");
+        else if (strcmp(token, wdl   ) == 0) learning.wdl          = strtof (strtok(nullptr, " "), nullptr);
+    if (!learn(&learning)) printf("info string could not open %s\n", learning.dataFile);
 }
 
 void uciLoop() {
     // Default configuration
-    UCI_Configuration config = {.hashSize = 16, .threads = 1};
+    UCI_Configuration config = {.hashSize = 16, .threads = 1, .multiPV = 1};
     parseFEN(&config.board, &histories[0], &config.accumulator, START_POS);
     createTranspositionTable(&config.tt, config.hashSize);
+    bookSeed = time(nullptr);
 
     char input[4096]; // Assumes input is large enough to hold '\n' from stdin
     char *token = nullptr;
@@ -195,16 +368,23 @@ void uciLoop() {
         // Official UCI Commands
         if      (strcmp(token, GO          ) == 0) go(&config);
         else if (strcmp(token, IS_READY    ) == 0) isReady();
+        else if (strcmp(token, PONDER_HIT  ) == 0) ponderHit();
         else if (strcmp(token, POSITION    ) == 0) position(&config.board, &config.accumulator);
         else if (strcmp(token, SET_OPTION  ) == 0) setOption(&config);
+        else if (strcmp(token, STOP        ) == 0) stop();
         else if (strcmp(token, UCI         ) == 0) uci();
         else if (strcmp(token, UCI_NEW_GAME) == 0) uciNewGame(&config.tt);
 
         // Unofficial UCI Commands
         else if (strcmp(token, BENCHMARK) == 0) benchmark();
+        else if (strcmp(token, CONVERT  ) == 0) convert();
         else if (strcmp(token, EVAL     ) == 0) eval(&config.accumulator, config.board.sideToMove);
         else if (strcmp(token, FEN      ) == 0) fen(&config.board);
+        else if (strcmp(token, LEARN    ) == 0) learnNetwork(&config);
+        else if (strcmp(token, PERFT    ) == 0) divide(&config);
         else if (strcmp(token, TRAIN    ) == 0) train(&config);
     }
+    stopSearchThreads();
     stopTrainingThreads();
+    closeBook();
 }
@@ -13,6 +13,8 @@ typedef struct UCI_Configuration {
     TT tt; // TODO: May not be needed
     size_t hashSize;
     uint8_t threads;
+    uint8_t multiPV;
+    bool ownBook;
 } UCI_Configuration;
 
 void uciLoop();
@@ -178,6 +178,10 @@ static inline int max(int a, int b) {
     return a >= b ? a : b;
 }
 
+static inline int min(int a, int b) {
+    return a <= b ? a : b;
+}
+
 static inline bool isAdjacentSquare(Square fromSq, Square toSq) {
     int rankDistance = abs((int) squareToRank(toSq) - (int) squareToRank(fromSq));
     int fileDistance = abs((int) squareToFile(toSq) - (int) squareToFile(fromSq));